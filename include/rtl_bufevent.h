@@ -0,0 +1,81 @@
+#ifndef _RTL_BUFEVENT_H_
+#define _RTL_BUFEVENT_H_
+
+#include <stddef.h>
+
+#include "rtl_event.h"
+
+/*
+ * buffered connection on top of rtl_event. input and output are chains
+ * of fixed-size segments taken from a per-thread pool, reads drain the
+ * fd until EAGAIN (suited to edge-triggered events) and the output chain
+ * is sent with writev.
+ *
+ * data written from inside the read callback is gathered and sent with
+ * one writev once the callback returns, writes made from elsewhere are
+ * sent right away. the bufevent owns fd and closes it on destroy, and
+ * SIGPIPE should be ignored by the process.
+ */
+#define RTL_BUFEVENT_SEG_SIZE	4096
+
+enum rtl_bufevent_what {
+	BEV_EOF   = 1<<0,
+	BEV_ERROR = 1<<1,
+};
+
+struct rtl_bufseg {
+	struct rtl_bufseg *next;
+	size_t off;					/* first unread byte */
+	size_t len;					/* end of the data */
+	char data[RTL_BUFEVENT_SEG_SIZE];
+};
+
+struct rtl_bufchain {
+	struct rtl_bufseg *head;
+	struct rtl_bufseg *tail;
+	size_t len;
+};
+
+struct rtl_bufevent;
+typedef void (*rtl_bufevent_cb)(struct rtl_bufevent *bev, void *args);
+typedef void (*rtl_bufevent_event_cb)(struct rtl_bufevent *bev, int what,
+		void *args);
+
+struct rtl_bufevent {
+	struct rtl_event_base *eb;
+	struct rtl_event *ev;
+	struct rtl_bufchain input;
+	struct rtl_bufchain output;
+	/* output watermarks */
+	size_t low;
+	size_t high;
+	int above_high;
+	int in_cb;
+	int closing;
+	int reported;				/* BEV_* already passed to eventcb */
+	rtl_bufevent_cb readcb;
+	rtl_bufevent_cb writecb;	/* output drained to the low watermark */
+	rtl_bufevent_cb highcb;		/* output grew above the high watermark */
+	rtl_bufevent_event_cb eventcb;
+	void *args;
+};
+
+struct rtl_bufevent *rtl_bufevent_create(struct rtl_event_base *eb, int fd,
+		rtl_bufevent_cb readcb, rtl_bufevent_cb writecb,
+		rtl_bufevent_event_cb eventcb, void *args);
+void rtl_bufevent_destroy(struct rtl_bufevent *bev);
+/* high == 0 disables the high watermark callback */
+void rtl_bufevent_set_watermark(struct rtl_bufevent *bev, size_t low,
+		size_t high, rtl_bufevent_cb highcb);
+
+int rtl_bufevent_write(struct rtl_bufevent *bev, const void *data, size_t len);
+int rtl_bufevent_flush(struct rtl_bufevent *bev);
+size_t rtl_bufevent_output_len(const struct rtl_bufevent *bev);
+
+size_t rtl_bufevent_input_len(const struct rtl_bufevent *bev);
+size_t rtl_bufevent_read(struct rtl_bufevent *bev, void *data, size_t len);
+/* zero-copy access to the first contiguous chunk of input */
+void *rtl_bufevent_peek(struct rtl_bufevent *bev, size_t *len);
+void rtl_bufevent_drain(struct rtl_bufevent *bev, size_t len);
+
+#endif /* _RTL_BUFEVENT_H_ */
@@ -0,0 +1,57 @@
+#ifndef _RTL_COROUTINE_H_
+#define _RTL_COROUTINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "rtl_event.h"
+
+/*
+ * stackful coroutines driven by an rtl_event_base. each coroutine runs
+ * on its own mmap'd stack with a guard page and is switched to with a
+ * few instructions (ucontext on other architectures than x86_64).
+ *
+ * the rtl_co_* socket calls look blocking but suspend the coroutine on
+ * EAGAIN until the loop reports readiness, so sequential protocol code
+ * can serve many connections on one thread. an fd used with them is
+ * made non-blocking and registered with the loop on first use, it must
+ * be closed with rtl_co_close. coroutines and their fds belong to the
+ * thread running the loop of their base.
+ */
+#define RTL_COROUTINE_STACK		(64 * 1024)
+
+typedef struct rtl_coroutine rtl_coroutine_t;
+typedef void (*rtl_coroutine_fn)(void *args);
+
+/*
+ * start fn(args) as a coroutine inside the loop of eb, it is freed when
+ * fn returns. stack_size 0 means RTL_COROUTINE_STACK.
+ */
+rtl_coroutine_t *rtl_coroutine_create(struct rtl_event_base *eb,
+		rtl_coroutine_fn fn, void *args, size_t stack_size);
+/* the running coroutine, NULL outside of coroutines */
+rtl_coroutine_t *rtl_coroutine_self(void);
+/* let the loop and the other coroutines run, then continue */
+void rtl_coroutine_yield(void);
+void rtl_coroutine_sleep(int64_t ms);
+
+/*
+ * suspend until fd is ready for what (EVENT_READ or EVENT_WRITE), at
+ * most ms milliseconds or forever if ms < 0. return -1 on timeout.
+ */
+int rtl_co_wait(int fd, int what, int64_t ms);
+
+ssize_t rtl_co_read(int fd, void *buf, size_t len);
+ssize_t rtl_co_write(int fd, const void *buf, size_t len);
+/* same semantics as rtl_socket_recv/recvn/send/sendn */
+int rtl_co_recv(int fd, void *buf, size_t len);
+int rtl_co_recvn(int fd, void *buf, size_t len);
+int rtl_co_send(int fd, const void *buf, size_t len);
+int rtl_co_sendn(int fd, const void *buf, size_t len);
+int rtl_co_accept(int fd, uint32_t *ip, uint16_t *port);
+int rtl_co_connect(int fd, const struct sockaddr *addr, socklen_t len);
+void rtl_co_close(int fd);
+
+#endif /* _RTL_COROUTINE_H_ */
@@ -1,8 +1,12 @@
 #ifndef _RTL_EVENT_H_
 #define _RTL_EVENT_H_
 
+#include <stdint.h>
+#include <signal.h>
 #include <sys/time.h>
 
+#include "rtl_rbtree.h"
+
 enum rtl_event_flags {
 	EVENT_TIMEOUT  = 1<<0,
 	EVENT_READ     = 1<<1,
@@ -14,8 +18,18 @@ enum rtl_event_flags {
 	EVENT_CLOSED   = 1<<7,
 	EVENT_ERROR    = 1<<8,
 	EVENT_EXCEPT   = 1<<9,
+	EVENT_EXCLUSIVE = 1<<10,
 };
 
+/*
+ * trigger modes of fd events, rtl_event_create sets EVENT_PERSIST|EVENT_ET:
+ *   EVENT_ET        edge-triggered, level-triggered when cleared
+ *   EVENT_PERSIST   stays armed after firing, when cleared the event is
+ *                   one-shot (EPOLLONESHOT) and rtl_event_mod re-arms it
+ *   EVENT_EXCLUSIVE EPOLLEXCLUSIVE wakeup for fds shared by several loops,
+ *                   CLOSED and one-shot mode are ignored together with it
+ */
+
 struct rtl_event;
 struct rtl_event_cbs {
 	void (*ev_in)(struct rtl_event *event, void *args);
@@ -27,15 +41,86 @@ struct rtl_event_cbs {
 struct rtl_event {
 	int evfd;
 	int flags;
+	/* points to cbs below */
 	struct rtl_event_cbs *evcb;
+	struct rtl_event_cbs cbs;
+	/* base the event is added to, NULL when it is not */
+	struct rtl_event_base *base;
+};
+
+/* slots of the per-base fd-indexed event slab, allocated in chunks */
+#define RTL_EVENT_SLAB_SHIFT	8
+#define RTL_EVENT_SLAB_CHUNK	(1 << RTL_EVENT_SLAB_SHIFT)
+
+/*
+ * timers are kept in a red-black tree ordered by monotonic expire time,
+ * add and del are O(log n), the nearest deadline is cached.
+ */
+struct rtl_event_timer {
+	struct rtl_rb_node node;
+	uint64_t expire;	/* monotonic time in microseconds */
+	uint64_t interval;	/* microseconds, used by EVENT_PERSIST timers */
+	int flags;
+	void (*cb)(struct rtl_event_timer *timer, void *args);
+	void *args;
+	struct rtl_event_base *base;	/* the base it is pending in */
+};
+
+/* a function posted into a loop by rtl_event_base_post */
+struct rtl_event_task {
+	struct rtl_event_task *next;
+	void (*fn)(void *args);
+	void *args;
+};
+
+/*
+ * opt-in latency instrumentation, see rtl_event_base_instrument.
+ * histogram bucket i counts durations in [2^(i-1), 2^i) microseconds,
+ * bucket 0 counts durations below 1us and the last one everything above.
+ */
+#define RTL_EVENT_HIST_BUCKETS	24
+#define RTL_EVENT_SLOW_RECORDS	16
+
+struct rtl_event_slow {
+	int fd;						/* -1 for timer callbacks */
+	void *cb;					/* address of the slow callback */
+	uint64_t usec;				/* its duration */
+	uint64_t when;				/* monotonic time it returned, in us */
+};
+
+struct rtl_event_latency {
+	uint64_t iter_hist[RTL_EVENT_HIST_BUCKETS];	/* wakeup to end of its callbacks */
+	uint64_t cb_hist[RTL_EVENT_HIST_BUCKETS];	/* single callbacks */
+	uint64_t lag_hist[RTL_EVENT_HIST_BUCKETS];	/* runnable to callback start */
+	uint64_t lag_max;
+	uint64_t slow_usec;			/* threshold of the slow-callback detector */
+	uint64_t nslow;				/* slow callbacks seen, the last */
+	struct rtl_event_slow slow[RTL_EVENT_SLOW_RECORDS];	/* ones kept here */
 };
 
 struct rtl_event_base;
+typedef void (*rtl_event_signal_cb)(struct rtl_event_base *eb, int signo,
+		void *args);
+
+struct rtl_event_sighandler {
+	rtl_event_signal_cb cb;
+	void *args;
+};
+
+/*
+ * dispatch waits at most tv, forever if tv is NULL, runs the callbacks
+ * of the ready events and returns their number: 0 on a timeout or an
+ * interrupted wait, -1 on failure. a callback may del and free another
+ * event of the same wakeup, so del must also drop whatever the running
+ * dispatch still holds for it.
+ */
 struct rtl_event_ops {
+	const char *name;
 	void *(*init)(void);
 	void (*deinit)(void *ctx);
 	int (*add)(struct rtl_event_base *eb, struct rtl_event *e);
 	int (*del)(struct rtl_event_base *eb, struct rtl_event *e);
+	int (*mod)(struct rtl_event_base *eb, struct rtl_event *e);
 	int (*dispatch)(struct rtl_event_base *eb, struct timeval *tv);
 };
 
@@ -43,17 +128,85 @@ struct rtl_event_base {
 	/* pointer to backend-specific data */
 	void *ctx;
 	int loop;
-	int rfd;
-	int wfd;
+	/* eventfd used to wake the loop up from other threads */
+	int wakefd;
+	struct rtl_event *wakeev;
 	const struct rtl_event_ops *evop;
+	struct rtl_rb_root timers;
+	struct rtl_rb_node *timer_first;
+	/* intrusive MPSC queue of posted tasks, producers push at post_head */
+	struct rtl_event_task *post_head;
+	struct rtl_event_task *post_tail;
+	struct rtl_event_task post_stub;
+	int post_notified;
+	/* EVENT_SIGNAL support, created on the first rtl_event_signal_add */
+	int sigfd;
+	struct rtl_event *sigev;
+	sigset_t sigmask;
+	struct rtl_event_sighandler *sighandlers;
+	/* counters behind rtl_event_base_stats */
+	uint64_t wake_usec;
+	uint64_t stat_since;
+	uint64_t stat_wakeups;
+	uint64_t stat_events;
+	uint64_t stat_cb_usec;
+	/* NULL unless instrumentation is enabled */
+	struct rtl_event_latency *lat;
+	/* event whose callbacks are running, NULL once it is deleted */
+	struct rtl_event *active;
+	/* fd-indexed event slab, a table of RTL_EVENT_SLAB_CHUNK sized chunks */
+	struct rtl_event **slab;
+	int nslab;
+};
+
+struct rtl_event_stats {
+	uint64_t wakeups;			/* dispatch returns with events or a timeout */
+	uint64_t events;			/* ready events handed to callbacks */
+	uint64_t cb_usec;			/* time spent in fd and timer callbacks */
+	uint64_t uptime_usec;		/* time since creation or the last reset */
+	double events_per_wakeup;
+	double wakeups_per_sec;
 };
 
 struct rtl_event_base *rtl_event_base_create(void);
+/* backend: "epoll" or "io_uring", NULL picks the first one available */
+struct rtl_event_base *rtl_event_base_create_backend(const char *backend);
+const char *rtl_event_base_backend(const struct rtl_event_base *eb);
 void rtl_event_base_destroy(struct rtl_event_base *);
 int rtl_event_base_loop(struct rtl_event_base *);
 void rtl_event_base_loop_break(struct rtl_event_base *);
+/* one loop iteration, returns what the backend dispatch returned */
 int rtl_event_base_wait(struct rtl_event_base *eb);
 void rtl_event_base_signal(struct rtl_event_base *eb);
+/*
+ * run fn(args) inside the loop thread, safe to call from any thread.
+ * posted tasks are drained once per dispatch and a burst of posts made
+ * before the loop wakes up costs a single eventfd write.
+ */
+int rtl_event_base_post(struct rtl_event_base *eb, void (*fn)(void *), void *args);
+void rtl_event_base_stats(const struct rtl_event_base *eb, struct rtl_event_stats *st);
+void rtl_event_base_stats_reset(struct rtl_event_base *eb);
+
+/*
+ * enable or disable latency instrumentation of the dispatch loop, every
+ * callback running longer than slow_usec is recorded with its fd and
+ * address. rtl_event_base_latency copies the data out and fails when
+ * instrumentation is disabled.
+ */
+int rtl_event_base_instrument(struct rtl_event_base *eb, int enable,
+		uint64_t slow_usec);
+int rtl_event_base_latency(const struct rtl_event_base *eb,
+		struct rtl_event_latency *lat);
+void rtl_event_base_latency_reset(struct rtl_event_base *eb);
+
+/*
+ * for backends: rtl_event_base_ready is called once per wakeup with the
+ * number of ready events, rtl_event_base_active runs the callbacks of e
+ * selected by what (EVENT_READ, EVENT_WRITE, EVENT_ERROR) and stops as
+ * soon as one of them deletes e.
+ */
+void rtl_event_base_ready(struct rtl_event_base *eb, int nready);
+void rtl_event_base_active(struct rtl_event_base *eb, struct rtl_event *e, int what);
 
 struct rtl_event *rtl_event_create(int fd,
 		void (*ev_in)(struct rtl_event *, void *),
@@ -61,8 +214,49 @@ struct rtl_event *rtl_event_create(int fd,
 		void (*ev_err)(struct rtl_event *, void *),
 		void *args);
 
+/* destroy deletes e from its base if needed and closes the fd */
 void rtl_event_destroy(struct rtl_event *e);
+
+/*
+ * events kept in the base's fd-indexed slab: slots are never freed or
+ * moved, so after the first use of an fd range create and destroy do not
+ * touch malloc. only one slot event may exist per fd, rtl_event_lookup
+ * returns it. slot events must be destroyed with rtl_event_slot_destroy,
+ * which deletes them from eb first.
+ */
+struct rtl_event *rtl_event_slot_create(struct rtl_event_base *eb, int fd,
+		void (*ev_in)(struct rtl_event *, void *),
+		void (*ev_out)(struct rtl_event *, void *),
+		void (*ev_err)(struct rtl_event *, void *),
+		void *args);
+void rtl_event_slot_destroy(struct rtl_event_base *eb, struct rtl_event *e);
+struct rtl_event *rtl_event_lookup(struct rtl_event_base *eb, int fd);
 int rtl_event_add(struct rtl_event_base *eb, struct rtl_event *e);
 int rtl_event_del(struct rtl_event_base *eb, struct rtl_event *e);
+/* replace the interest and trigger flags of an added event in one call */
+int rtl_event_mod(struct rtl_event_base *eb, struct rtl_event *e, int flags);
+
+/*
+ * EVENT_SIGNAL: the signal is blocked and read from a signalfd, so cb runs
+ * as a normal callback inside the loop. signals are only blocked in the
+ * calling thread, add them before other threads are created or block them
+ * there too, otherwise the kernel may still deliver them asynchronously.
+ */
+int rtl_event_signal_add(struct rtl_event_base *eb, int signo,
+		rtl_event_signal_cb cb, void *args);
+int rtl_event_signal_del(struct rtl_event_base *eb, int signo);
+
+struct rtl_event_timer *rtl_event_timer_create(
+		void (*cb)(struct rtl_event_timer *, void *), void *args);
+void rtl_event_timer_destroy(struct rtl_event_timer *t);
+/*
+ * flags: EVENT_PERSIST re-arms the timer every tv after it fires. a timer
+ * belongs to the base it was last added to, del and destroy unlink it from
+ * there whatever eb is passed.
+ */
+int rtl_event_timer_add(struct rtl_event_base *eb, struct rtl_event_timer *t,
+		const struct timeval *tv, int flags);
+int rtl_event_timer_del(struct rtl_event_base *eb, struct rtl_event_timer *t);
+int rtl_event_timer_pending(const struct rtl_event_timer *t);
 
 #endif /* _RTL_EVENT_H_ */
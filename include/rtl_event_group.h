@@ -0,0 +1,27 @@
+#ifndef _RTL_EVENT_GROUP_H_
+#define _RTL_EVENT_GROUP_H_
+
+#include <stdint.h>
+
+#include "rtl_event.h"
+
+/*
+ * a group of rtl_event_base loops, one per worker thread pinned to a cpu.
+ * every worker owns its own SO_REUSEPORT listener on the same address, so
+ * the kernel spreads new connections across workers and an accepted fd is
+ * served by the loop (and cpu) that accepted it.
+ */
+struct rtl_event_group;
+
+/* called in the worker's thread for every accepted, non-blocking fd */
+typedef void (*rtl_event_group_accept_cb)(struct rtl_event_base *eb, int fd,
+		uint32_t ip, uint16_t port, void *args);
+
+/* nworkers <= 0 means one worker per online cpu */
+struct rtl_event_group *rtl_event_group_create(int nworkers, const char *host,
+		uint16_t port, rtl_event_group_accept_cb cb, void *args);
+void rtl_event_group_destroy(struct rtl_event_group *g);
+int rtl_event_group_size(const struct rtl_event_group *g);
+struct rtl_event_base *rtl_event_group_base(struct rtl_event_group *g, int i);
+
+#endif /* _RTL_EVENT_GROUP_H_ */
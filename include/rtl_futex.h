@@ -0,0 +1,89 @@
+#ifndef _RTL_FUTEX_H_
+#define _RTL_FUTEX_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/*
+ * thin wrappers of the futex syscall. the private variants are for words
+ * only seen by one process, the shared ones for words in shared memory.
+ */
+static inline int rtl_futex_wait(int *uaddr, int val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static inline int rtl_futex_wake(int *uaddr, int n)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+static inline int rtl_futex_wait_shared(int *uaddr, int val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+static inline int rtl_futex_wake_shared(int *uaddr, int n)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+/* CLOCK_MONOTONIC time in nanoseconds, for timeout bookkeeping */
+static inline int64_t rtl_futex_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * futex based locks that can be embedded in other structs and need no
+ * init call besides their static initializer. they spin for a while on
+ * multi-cpu machines before sleeping and never print on contention.
+ * timeouts are in milliseconds, a negative one waits forever and 0 does
+ * not sleep at all.
+ */
+typedef struct {
+	int state;		/* 0 unlocked, 1 locked, 2 locked with waiters */
+} rtl_futex_mutex_t;
+
+typedef struct {
+	int seq;
+} rtl_futex_cond_t;
+
+typedef struct {
+	int value;
+	int waiters;
+} rtl_futex_sem_t;
+
+#define RTL_FUTEX_MUTEX_INITIALIZER		{ 0 }
+#define RTL_FUTEX_COND_INITIALIZER		{ 0 }
+#define RTL_FUTEX_SEM_INITIALIZER(n)	{ (n), 0 }
+
+void rtl_futex_mutex_init(rtl_futex_mutex_t *m);
+int rtl_futex_mutex_lock(rtl_futex_mutex_t *m);
+/* return 0 on success, EBUSY if the mutex is held */
+int rtl_futex_mutex_trylock(rtl_futex_mutex_t *m);
+int rtl_futex_mutex_unlock(rtl_futex_mutex_t *m);
+
+void rtl_futex_cond_init(rtl_futex_cond_t *c);
+/*
+ * return ETIMEDOUT on timeout, the mutex is held again either way. unlike
+ * rtl_mutex_cond_wait, which also waits forever for 0, a 0 timeout only
+ * drops and retakes the mutex and returns ETIMEDOUT if nothing woke it.
+ */
+int rtl_futex_cond_wait(rtl_futex_cond_t *c, rtl_futex_mutex_t *m, int64_t ms);
+void rtl_futex_cond_signal(rtl_futex_cond_t *c);
+void rtl_futex_cond_signal_all(rtl_futex_cond_t *c);
+
+void rtl_futex_sem_init(rtl_futex_sem_t *s, int value);
+/* return -1 on timeout */
+int rtl_futex_sem_wait(rtl_futex_sem_t *s, int64_t ms);
+int rtl_futex_sem_trywait(rtl_futex_sem_t *s);
+int rtl_futex_sem_signal(rtl_futex_sem_t *s);
+
+#endif /* _RTL_FUTEX_H_ */
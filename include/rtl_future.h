@@ -0,0 +1,44 @@
+#ifndef _RTL_FUTURE_H_
+#define _RTL_FUTURE_H_
+
+#include <stdint.h>
+
+#include "rtl_pool.h"
+#include "rtl_event.h"
+
+/*
+ * futures and task graphs on top of rtl_pool. a future is a task whose
+ * result can be waited for, and a task may depend on other futures: it
+ * is handed to the pool as soon as the last of them completes, so a
+ * "parse N files, then merge" job is N futures and one dependent.
+ *
+ * futures are reference counted, rtl_future_release() drops the
+ * caller's reference whenever it is done with the result. tasks should
+ * express their inputs as dependencies rather than block in
+ * rtl_future_get(), which would tie up a pool worker.
+ */
+typedef struct rtl_future rtl_future_t;
+typedef void *(*rtl_future_fn)(void *args);
+typedef void (*rtl_future_cb)(rtl_future_t *f, void *args);
+
+rtl_future_t *rtl_future_submit(rtl_pool_t *pool, rtl_future_fn fn, void *args);
+/* run fn once every future in deps has completed */
+rtl_future_t *rtl_future_submit_after(rtl_pool_t *pool, rtl_future_fn fn,
+		void *args, rtl_future_t **deps, int ndeps);
+void rtl_future_release(rtl_future_t *f);
+
+int rtl_future_ready(rtl_future_t *f);
+/* wait up to ms milliseconds, forever if ms < 0, return -1 on timeout */
+int rtl_future_wait(rtl_future_t *f, int64_t ms);
+/* block until completion and return what the task returned */
+void *rtl_future_get(rtl_future_t *f);
+
+/*
+ * call cb once f completes, inside the loop of eb through
+ * rtl_event_base_post(), or on the completing worker if eb is NULL.
+ * if f is already complete cb is posted, or called right away.
+ */
+int rtl_future_then(rtl_future_t *f, struct rtl_event_base *eb,
+		rtl_future_cb cb, void *args);
+
+#endif /* _RTL_FUTURE_H_ */
@@ -5,12 +5,40 @@
 
 /*
  * spin lock implemented by atomic APIs
+ *
+ * RTL_SPIN_TAS is the default test-and-set lock, cheap but unfair under
+ * contention. RTL_SPIN_TICKET hands the lock over in FIFO order and
+ * RTL_SPIN_MCS does too while every waiter spins on its own queue node,
+ * so the lock word does not bounce between waiting cpus. an MCS lock
+ * must be unlocked by the thread that locked it, and a thread may hold
+ * up to RTL_MCS_NESTING of them at once.
  */
+enum rtl_spin_type {
+	RTL_SPIN_TAS,
+	RTL_SPIN_TICKET,
+	RTL_SPIN_MCS,
+};
+
+#define RTL_MCS_NESTING	32
+
+struct rtl_mcs_node {
+	struct rtl_mcs_node *next;
+	int wait;
+};
+
 typedef struct {
 	int lock;
 	int ncpu;
+	int type;
+	/* ticket lock */
+	unsigned int ticket;
+	unsigned int owner;
+	/* mcs lock */
+	struct rtl_mcs_node *tail;
+	struct rtl_mcs_node *holder;
 } rtl_spin_lock_t;
 rtl_spin_lock_t *rtl_spin_lock_init();
+rtl_spin_lock_t *rtl_spin_lock_init_type(int type);
 int rtl_spin_lock(rtl_spin_lock_t *lock);
 int rtl_spin_unlock(rtl_spin_lock_t *lock);
 int rtl_spin_trylock(rtl_spin_lock_t *lock);
@@ -33,6 +61,7 @@ void rtl_mutex_lock_deinit(rtl_mutex_lock_t *lock);
  */
 typedef void rtl_mutex_cond_t;
 rtl_mutex_cond_t *rtl_mutex_cond_init();
+/* ms <= 0 waits forever, see rtl_futex_cond_wait for the futex variant */
 int rtl_mutex_cond_wait(rtl_mutex_lock_t *mutex, rtl_mutex_cond_t *cond, int64_t ms);
 void rtl_mutex_cond_signal(rtl_mutex_cond_t *cond);
 void rtl_mutex_cond_signal_all(rtl_mutex_cond_t *cond);
@@ -52,6 +81,45 @@ int rtl_rwlock_unlock(rtl_rwlock_t *lock);
 void rtl_rwlock_deinit(rtl_rwlock_t *lock);
 
 
+/*
+ * big-reader lock for read-mostly data such as routing tables. every
+ * thread counts itself in one of several cache-line sized reader slots,
+ * so readers on different cpus do not share a counter. a writer blocks
+ * new readers and waits for all slots to drain, which makes writes
+ * expensive. a read lock must be released by the thread that took it.
+ */
+typedef struct rtl_brlock rtl_brlock_t;
+rtl_brlock_t *rtl_brlock_init();
+int rtl_brlock_rdlock(rtl_brlock_t *lock);
+int rtl_brlock_rdunlock(rtl_brlock_t *lock);
+int rtl_brlock_wrlock(rtl_brlock_t *lock);
+int rtl_brlock_wrunlock(rtl_brlock_t *lock);
+void rtl_brlock_deinit(rtl_brlock_t *lock);
+
+
+/*
+ * lock contention profiling, enabled by building the library and its
+ * users with RTL_LOCK_PROFILE defined (make LOCK_PROFILE=1). mutexes and
+ * rwlocks then count acquisitions, contended acquisitions and the time
+ * spent waiting. locks are reported by name, or by the call site of
+ * their init when unnamed, and the ones sharing a key are summed up.
+ * without the flag all of this compiles to nothing.
+ */
+#ifdef RTL_LOCK_PROFILE
+#include <stdio.h>
+void rtl_mutex_lock_set_name(rtl_mutex_lock_t *lock, const char *name);
+void rtl_rwlock_set_name(rtl_rwlock_t *lock, const char *name);
+/* print the topn most contended keys, all of them if topn <= 0 */
+void rtl_lock_profile_dump(FILE *fp, int topn);
+void rtl_lock_profile_reset(void);
+#else
+#define rtl_mutex_lock_set_name(lock, name)	((void)0)
+#define rtl_rwlock_set_name(lock, name)		((void)0)
+#define rtl_lock_profile_dump(fp, topn)		((void)0)
+#define rtl_lock_profile_reset()			((void)0)
+#endif
+
+
 /*
  * sem lock implemented by Unnamed semaphores (memory-based semaphores) APIs
  */
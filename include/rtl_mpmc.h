@@ -0,0 +1,30 @@
+#ifndef _RTL_MPMC_H_
+#define _RTL_MPMC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * bounded multi-producer multi-consumer queue of pointers, D. Vyukov's
+ * design: every cell carries a sequence number, so producers and
+ * consumers only contend on their own index. the blocking variants
+ * park on a futex and are woken by the opposite side.
+ */
+typedef struct rtl_mpmc rtl_mpmc_t;
+
+/* size is rounded up to a power of two */
+rtl_mpmc_t *rtl_mpmc_create(size_t size);
+void rtl_mpmc_destroy(rtl_mpmc_t *q);
+
+/* return 0 on success, -1 if the queue is full or empty */
+int rtl_mpmc_trypush(rtl_mpmc_t *q, void *data);
+int rtl_mpmc_trypop(rtl_mpmc_t *q, void **data);
+
+/* wait up to ms milliseconds, forever if ms < 0, return -1 on timeout */
+int rtl_mpmc_push(rtl_mpmc_t *q, void *data, int64_t ms);
+int rtl_mpmc_pop(rtl_mpmc_t *q, void **data, int64_t ms);
+
+/* approximate number of queued items */
+size_t rtl_mpmc_count(rtl_mpmc_t *q);
+
+#endif /* _RTL_MPMC_H_ */
@@ -0,0 +1,27 @@
+#ifndef _RTL_POOL_H_
+#define _RTL_POOL_H_
+
+/*
+ * work-stealing thread pool for cpu-bound jobs. every worker owns a
+ * Chase-Lev deque: tasks submitted from a worker are pushed to its own
+ * deque without locking, tasks submitted from other threads go through
+ * a shared injection queue. idle workers steal from random victims and
+ * park on a condition variable when nothing is left.
+ */
+typedef struct rtl_pool rtl_pool_t;
+
+/* nworkers <= 0 means one worker per online cpu */
+rtl_pool_t *rtl_pool_create(int nworkers);
+/* waits for every submitted task, then stops the workers */
+void rtl_pool_destroy(rtl_pool_t *pool);
+int rtl_pool_size(const rtl_pool_t *pool);
+
+int rtl_pool_submit(rtl_pool_t *pool, void (*fn)(void *), void *args);
+/*
+ * block until every task submitted so far, including the ones they
+ * submit, has finished. called from a task it only waits for the tasks
+ * that task submitted and their descendants, and runs tasks meanwhile.
+ */
+void rtl_pool_wait(rtl_pool_t *pool);
+
+#endif /* _RTL_POOL_H_ */
@@ -17,6 +17,12 @@ typedef struct {
 
 int rtl_proc_spawn(rtl_spawn_proc_pt proc, void *args, char *name, int respawn);
 void rtl_proc_wait(void);
+/*
+ * reap and respawn every exited child without blocking, suited to a
+ * SIGCHLD handler registered with rtl_event_signal_add.
+ * returns the number of children reaped.
+ */
+int rtl_proc_reap(void);
 
 extern int rtl_last_proc;
 extern int rtl_proc_slot;
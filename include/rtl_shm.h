@@ -1,7 +1,10 @@
 #ifndef _RTL_SHM_H_
 #define _RTL_SHM_H_
 
+#include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
 
 struct rtl_heap_mem {
 	uint16_t magic;
@@ -9,21 +12,128 @@ struct rtl_heap_mem {
 	size_t next, prev;
 };
 
+/*
+ * RTL_SHM_FIRST_FIT walks a list of blocks from the lowest free one, so
+ * allocation gets slower as the heap fragments. RTL_SHM_TLSF keeps free
+ * blocks in segregated lists indexed by two-level bitmaps (Two-Level
+ * Segregated Fit), malloc and free are O(1) and a request never wastes
+ * more than 1/32 of its size. its lists link blocks by their offset
+ * in the heap rather than by address.
+ */
+enum rtl_shm_mode {
+	RTL_SHM_FIRST_FIT,
+	RTL_SHM_TLSF,
+};
+
 typedef struct {
+	int mode;
 	uint8_t *heap_addr;
 	uint8_t *heap_ptr;
-	int heap_sem_id;
+	/*
+	 * robust process-shared mutex, taken without a syscall when
+	 * uncontended. if a process dies holding it the next one to lock
+	 * it rebuilds the free lists from the block headers.
+	 */
+	pthread_mutex_t heap_lock;
 	struct rtl_heap_mem *lfree;
 	struct rtl_heap_mem *heap_end;
 	size_t mem_size_aligned;
+	/* named segments: mapping size and the handle to attach with */
+	size_t map_size;
+	char handle[64];
+	/* memfd behind a hugetlb segment, open in process memfd_pid only */
+	int memfd;
+	pid_t memfd_pid;
 } rtl_shm_ctl_block_t;
 
 rtl_shm_ctl_block_t *rtl_shm_init(size_t size);
+rtl_shm_ctl_block_t *rtl_shm_init_mode(size_t size, int mode);
+/*
+ * named segments. rtl_shm_init() segments are only shared with forked
+ * children, a named one can be attached by any process that knows its
+ * handle, e.g. a sidecar tool inspecting a running worker. the segment
+ * lives in a POSIX shared memory object, or a memfd when it is backed
+ * by reserved huge pages; the handle is then /proc/<pid>/fd/<fd> and
+ * valid while the creator runs. rtl_shm_attach() maps a segment at the
+ * address the creator used, since the control block stores addresses,
+ * and fails if that range is taken in the attaching process.
+ */
+#define RTL_SHM_HUGETLB		0x01	/* hugetlb pages, see /proc/sys/vm/nr_hugepages */
+#define RTL_SHM_THP			0x02	/* madvise(MADV_HUGEPAGE) */
+
+/* name is a POSIX shm name such as "/cache" */
+rtl_shm_ctl_block_t *rtl_shm_create(const char *name, size_t size, int mode, int flags);
+/* handle is a name given to rtl_shm_create() or a scb->handle */
+rtl_shm_ctl_block_t *rtl_shm_attach(const char *handle);
+int rtl_shm_unlink(const char *name);
+
+/* destroys the heap lock, the name stays for compatibility */
 int rtl_shm_sem_del(rtl_shm_ctl_block_t *scb);
+/* unmaps the segment, named or not, the creator also closes its memfd */
 int rtl_shm_mem_del(rtl_shm_ctl_block_t *scb);
 void *rtl_shm_malloc(rtl_shm_ctl_block_t *scb, size_t size);
 void *rtl_shm_realloc(rtl_shm_ctl_block_t *scb, void *rmem, size_t newsize);
 void *rtl_shm_calloc(rtl_shm_ctl_block_t *scb, size_t count, size_t size);
 void rtl_shm_free(rtl_shm_ctl_block_t *scb, void *rmem);
+/* n blocks of the same size under one lock, return how many were allocated */
+int rtl_shm_malloc_batch(rtl_shm_ctl_block_t *scb, size_t size, void **ptrs, int n);
+void rtl_shm_free_batch(rtl_shm_ctl_block_t *scb, void **ptrs, int n);
+/* size of the data area of an allocated block, at least what was asked */
+size_t rtl_shm_usable_size(rtl_shm_ctl_block_t *scb, void *rmem);
+
+/*
+ * heap introspection. the stats and the walk take the heap lock, so a
+ * walk callback must not call into the same heap. blocks held by caches
+ * count as used. a library built with RTL_SHM_DEBUG (make SHM_DEBUG=1)
+ * keeps the requested size and the return address of the allocating
+ * call in every block. rtl_shm_dump() then sums the live blocks by call
+ * site, addr2line turns the addresses into source lines. such a build
+ * also knows the blocks held by caches, it totals them in the stats and
+ * leaves them out of the walk. processes sharing a heap must all be
+ * built the same way.
+ */
+struct rtl_shm_stats {
+	size_t heap_size;		/* bytes managed by the heap */
+	size_t used_bytes;		/* data bytes of allocated blocks */
+	size_t free_bytes;
+	size_t largest_free;	/* data bytes of the largest free block */
+	size_t used_blocks;
+	size_t free_blocks;
+	size_t cached_bytes;	/* part of used_bytes, only with RTL_SHM_DEBUG */
+	size_t cached_blocks;
+	double fragmentation;	/* 1 - largest_free / free_bytes */
+};
+
+/* size is the requested size with RTL_SHM_DEBUG, else the usable size, caller NULL */
+typedef void (*rtl_shm_walk_fn)(void *rmem, size_t size, void *caller, void *args);
+
+int rtl_shm_stats(rtl_shm_ctl_block_t *scb, struct rtl_shm_stats *st);
+/* call fn for every allocated block not held by a cache */
+int rtl_shm_walk(rtl_shm_ctl_block_t *scb, rtl_shm_walk_fn fn, void *args);
+/* print the stats and the topn call sites by live bytes, all if topn <= 0 */
+void rtl_shm_dump(rtl_shm_ctl_block_t *scb, FILE *fp, int topn);
+
+/*
+ * cache of small blocks in front of a shared heap, one per thread or
+ * per process, never shared. blocks up to RTL_SHM_CACHE_MAX bytes are
+ * kept in size classes 16 bytes apart, each holding up to capacity
+ * blocks. an empty class is refilled and a full one drained batch
+ * blocks at a time with a single lock of the heap. cached blocks count
+ * as used in the heap until the cache is flushed, and a cache must be
+ * created after fork() since the child would share its blocks.
+ */
+#define RTL_SHM_CACHE_MAX		1024
+
+typedef struct rtl_shm_cache rtl_shm_cache_t;
+
+/* capacity and batch <= 0 pick the defaults */
+rtl_shm_cache_t *rtl_shm_cache_create(rtl_shm_ctl_block_t *scb, int capacity, int batch);
+/* flushes the cache */
+void rtl_shm_cache_destroy(rtl_shm_cache_t *cache);
+void *rtl_shm_cache_malloc(rtl_shm_cache_t *cache, size_t size);
+/* rmem may come from rtl_shm_malloc() or another cache of the heap */
+void rtl_shm_cache_free(rtl_shm_cache_t *cache, void *rmem);
+/* give every cached block back to the heap */
+void rtl_shm_cache_flush(rtl_shm_cache_t *cache);
 
 #endif /* _RTL_SHM_H_ */
@@ -0,0 +1,38 @@
+#ifndef _RTL_SPSC_H_
+#define _RTL_SPSC_H_
+
+#include <stddef.h>
+
+/*
+ * single-producer single-consumer ring for wiring two threads together,
+ * e.g. two rtl_thread_t stages of a pipeline. head and tail live on
+ * separate cache lines and each side caches the other's index, so the
+ * fast path is a few plain loads and stores without locks or syscalls.
+ *
+ * a ring is used either with fixed-size elements (push/pop) or, when
+ * created with elem_size 1, with variable-length records through the
+ * zero-copy reserve/commit and peek/release calls. never mix the two.
+ */
+typedef struct rtl_spsc rtl_spsc_t;
+
+/* nelems is rounded up to a power of two */
+rtl_spsc_t *rtl_spsc_create(size_t nelems, size_t elem_size);
+void rtl_spsc_destroy(rtl_spsc_t *q);
+
+/* copy up to n elements in or out, return the number transferred */
+size_t rtl_spsc_push(rtl_spsc_t *q, const void *elems, size_t n);
+size_t rtl_spsc_pop(rtl_spsc_t *q, void *elems, size_t n);
+/* approximate, exact when called by either side */
+size_t rtl_spsc_count(rtl_spsc_t *q);
+
+/*
+ * producer: reserve room for a record of up to len bytes and commit the
+ * bytes actually written. NULL if the ring is too full right now.
+ */
+void *rtl_spsc_reserve(rtl_spsc_t *q, size_t len);
+void rtl_spsc_commit(rtl_spsc_t *q, size_t len);
+/* consumer: look at the oldest record and release it when done */
+void *rtl_spsc_peek(rtl_spsc_t *q, size_t *len);
+void rtl_spsc_release(rtl_spsc_t *q);
+
+#endif /* _RTL_SPSC_H_ */
@@ -1,6 +1,7 @@
 #ifndef _RTL_THREAD_H_
 #define _RTL_THREAD_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <pthread.h>
 
@@ -8,8 +9,26 @@
 
 typedef struct rtl_thread rtl_thread_t;
 
+#define RTL_THREAD_MAX_CPUS		1024
+
+/*
+ * creation attributes, start from rtl_thread_attr_init(). zero sizes
+ * keep the pthread defaults, policy -1 inherits the creator's scheduling
+ * and an empty cpu set leaves the affinity alone. with lazy_sync the
+ * spin, mutex, cond and sem objects are only allocated on first use.
+ */
+typedef struct {
+	uint64_t cpus[RTL_THREAD_MAX_CPUS / 64];
+	size_t stack_size;
+	size_t guard_size;
+	int policy;				/* SCHED_OTHER, SCHED_FIFO, SCHED_RR or -1 */
+	int priority;
+	int lazy_sync;
+} rtl_thread_attr_t;
+
 struct rtl_thread {
 	pthread_t tid;
+	int lazy_sync;
 	rtl_spin_lock_t *spin;
 	rtl_mutex_lock_t *mutex;
 	rtl_mutex_cond_t *cond;
@@ -22,6 +41,14 @@ struct rtl_thread {
 rtl_thread_t *rtl_thread_create(void *(*func)(rtl_thread_t *),
 		const char *name, void *args);
 
+rtl_thread_t *rtl_thread_create_attr(void *(*func)(rtl_thread_t *),
+		const char *name, void *args, const rtl_thread_attr_t *attr);
+
+void rtl_thread_attr_init(rtl_thread_attr_t *attr);
+int rtl_thread_attr_set_cpu(rtl_thread_attr_t *attr, int cpu);
+/* add every cpu of a NUMA node to the cpu set */
+int rtl_thread_attr_set_node(rtl_thread_attr_t *attr, int node);
+
 void rtl_thread_destroy(rtl_thread_t *t);
 
 int rtl_thread_spin_lock(rtl_thread_t *t);
@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "rtl_bufevent.h"
+
+#define BEV_IOV_MAX			64
+#define BEV_POOL_MAX		256
+
+/* event loops are single threaded, so every thread keeps its own pool */
+static __thread struct rtl_bufseg *seg_pool;
+static __thread int seg_pool_size;
+
+static struct rtl_bufseg *seg_alloc(void)
+{
+	struct rtl_bufseg *seg = seg_pool;
+
+	if (seg) {
+		seg_pool = seg->next;
+		seg_pool_size--;
+	} else {
+		seg = malloc(sizeof(struct rtl_bufseg));
+		if (!seg) {
+			fprintf(stderr, "malloc rtl_bufseg failed!\n");
+			return NULL;
+		}
+	}
+	seg->next = NULL;
+	seg->off = 0;
+	seg->len = 0;
+	return seg;
+}
+
+static void seg_free(struct rtl_bufseg *seg)
+{
+	if (seg_pool_size >= BEV_POOL_MAX) {
+		free(seg);
+		return;
+	}
+	seg->next = seg_pool;
+	seg_pool = seg;
+	seg_pool_size++;
+}
+
+/* return a tail segment with free space, appending one if needed */
+static struct rtl_bufseg *chain_space(struct rtl_bufchain *chain)
+{
+	struct rtl_bufseg *seg = chain->tail;
+
+	if (seg && seg->len < RTL_BUFEVENT_SEG_SIZE)
+		return seg;
+	seg = seg_alloc();
+	if (!seg)
+		return NULL;
+	if (chain->tail)
+		chain->tail->next = seg;
+	else
+		chain->head = seg;
+	chain->tail = seg;
+	return seg;
+}
+
+static void chain_drain(struct rtl_bufchain *chain, size_t len)
+{
+	struct rtl_bufseg *seg;
+	size_t n;
+
+	if (len > chain->len)
+		len = chain->len;
+	chain->len -= len;
+	while ((seg = chain->head)) {
+		n = seg->len - seg->off;
+		if (len < n) {
+			seg->off += len;
+			break;
+		}
+		len -= n;
+		chain->head = seg->next;
+		if (!chain->head)
+			chain->tail = NULL;
+		seg_free(seg);
+	}
+}
+
+static void chain_free(struct rtl_bufchain *chain)
+{
+	struct rtl_bufseg *seg;
+
+	while ((seg = chain->head)) {
+		chain->head = seg->next;
+		seg_free(seg);
+	}
+	chain->tail = NULL;
+	chain->len = 0;
+}
+
+static void bufevent_free(struct rtl_bufevent *bev)
+{
+	rtl_event_del(bev->eb, bev->ev);
+	rtl_event_destroy(bev->ev);
+	chain_free(&bev->input);
+	chain_free(&bev->output);
+	free(bev);
+}
+
+/* leave a callback section, returns 1 if bev was destroyed inside it */
+static int bufevent_leave(struct rtl_bufevent *bev)
+{
+	if (--bev->in_cb == 0 && bev->closing) {
+		bufevent_free(bev);
+		return 1;
+	}
+	return 0;
+}
+
+static void bufevent_want_write(struct rtl_bufevent *bev, int enable)
+{
+	int flags = bev->ev->flags;
+
+	if (!!(flags & EVENT_WRITE) == !!enable)
+		return;
+	if (enable)
+		flags |= EVENT_WRITE;
+	else
+		flags &= ~EVENT_WRITE;
+	rtl_event_mod(bev->eb, bev->ev, flags);
+}
+
+/*
+ * writev the output chain until it is empty or the fd would block, write
+ * interest is only kept while data is pending, so level-triggered
+ * backends do not spin on a writable fd.
+ */
+static int bufevent_send(struct rtl_bufevent *bev)
+{
+	struct iovec iov[BEV_IOV_MAX];
+	struct rtl_bufseg *seg;
+	size_t start = bev->output.len;
+	ssize_t n;
+	int cnt;
+
+	while (bev->output.len) {
+		for (cnt = 0, seg = bev->output.head; seg && cnt < BEV_IOV_MAX;
+			 seg = seg->next, cnt++) {
+			iov[cnt].iov_base = seg->data + seg->off;
+			iov[cnt].iov_len = seg->len - seg->off;
+		}
+		n = writev(bev->ev->evfd, iov, cnt);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
+		}
+		chain_drain(&bev->output, n);
+	}
+	bufevent_want_write(bev, bev->output.len != 0);
+
+	if (bev->output.len <= bev->low) {
+		bev->above_high = 0;
+		if (start > bev->low && bev->writecb)
+			bev->writecb(bev, bev->args);
+	}
+	return 0;
+}
+
+/*
+ * report EOF and errors to eventcb once, a reset connection shows up as
+ * a failed read and as EVENT_ERROR of the same wakeup.
+ */
+static void bufevent_event(struct rtl_bufevent *bev, int what)
+{
+	what &= ~bev->reported;
+	if (!what || bev->closing)
+		return;
+	bev->reported |= what;
+	if (bev->eventcb)
+		bev->eventcb(bev, what, bev->args);
+}
+
+/* call inside a callback section only */
+static void bufevent_flush(struct rtl_bufevent *bev)
+{
+	int ret;
+
+	do {
+		ret = bufevent_send(bev);
+	} while (!ret && !bev->closing && bev->output.len &&
+			 !(bev->ev->flags & EVENT_WRITE));
+	if (ret < 0)
+		bufevent_event(bev, BEV_ERROR);
+}
+
+static void bufevent_in(struct rtl_event *e, void *args)
+{
+	struct rtl_bufevent *bev = (struct rtl_bufevent *)args;
+	struct rtl_bufseg *seg;
+	size_t got = 0;
+	ssize_t n;
+	int what = 0;
+
+	/* edge-triggered, so read until the kernel buffer is empty */
+	for (;;) {
+		seg = chain_space(&bev->input);
+		if (!seg) {
+			what = BEV_ERROR;
+			break;
+		}
+		n = read(e->evfd, seg->data + seg->len, RTL_BUFEVENT_SEG_SIZE - seg->len);
+		if (n > 0) {
+			seg->len += n;
+			bev->input.len += n;
+			got += n;
+			continue;
+		}
+		if (n == 0) {
+			what = BEV_EOF;
+		} else if (errno == EINTR) {
+			continue;
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			what = BEV_ERROR;
+		}
+		break;
+	}
+
+	bev->in_cb++;
+	if (got && bev->readcb)
+		bev->readcb(bev, bev->args);
+	/* send whatever the read callback produced with one writev */
+	if (!bev->closing && bev->output.len)
+		bufevent_flush(bev);
+	if (what)
+		bufevent_event(bev, what);
+	bufevent_leave(bev);
+}
+
+static void bufevent_out(struct rtl_event *e, void *args)
+{
+	struct rtl_bufevent *bev = (struct rtl_bufevent *)args;
+
+	bev->in_cb++;
+	bufevent_flush(bev);
+	bufevent_leave(bev);
+}
+
+static void bufevent_err(struct rtl_event *e, void *args)
+{
+	struct rtl_bufevent *bev = (struct rtl_bufevent *)args;
+
+	bev->in_cb++;
+	bufevent_event(bev, BEV_ERROR);
+	bufevent_leave(bev);
+}
+
+struct rtl_bufevent *rtl_bufevent_create(struct rtl_event_base *eb, int fd,
+		rtl_bufevent_cb readcb, rtl_bufevent_cb writecb,
+		rtl_bufevent_event_cb eventcb, void *args)
+{
+	struct rtl_bufevent *bev;
+
+	if (!eb || fd < 0) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return NULL;
+	}
+	bev = calloc(1, sizeof(struct rtl_bufevent));
+	if (!bev) {
+		fprintf(stderr, "calloc rtl_bufevent failed!\n");
+		return NULL;
+	}
+	bev->ev = rtl_event_create(fd, bufevent_in, bufevent_out, bufevent_err, bev);
+	if (!bev->ev) {
+		free(bev);
+		return NULL;
+	}
+	/* write interest is enabled only while output is pending */
+	bev->ev->flags &= ~EVENT_WRITE;
+	if (rtl_event_add(eb, bev->ev) < 0) {
+		/* leave fd to the caller */
+		free(bev->ev);
+		free(bev);
+		return NULL;
+	}
+	bev->eb = eb;
+	bev->readcb = readcb;
+	bev->writecb = writecb;
+	bev->eventcb = eventcb;
+	bev->args = args;
+	return bev;
+}
+
+void rtl_bufevent_destroy(struct rtl_bufevent *bev)
+{
+	if (!bev)
+		return;
+	/* freed when the running callback returns */
+	if (bev->in_cb) {
+		bev->closing = 1;
+		return;
+	}
+	bufevent_free(bev);
+}
+
+void rtl_bufevent_set_watermark(struct rtl_bufevent *bev, size_t low,
+		size_t high, rtl_bufevent_cb highcb)
+{
+	bev->low = low;
+	bev->high = high;
+	bev->highcb = highcb;
+}
+
+int rtl_bufevent_write(struct rtl_bufevent *bev, const void *data, size_t len)
+{
+	const char *p = (const char *)data;
+	struct rtl_bufseg *seg;
+	size_t n;
+
+	if (!bev || bev->closing)
+		return -1;
+	while (len) {
+		seg = chain_space(&bev->output);
+		if (!seg)
+			return -1;
+		n = RTL_BUFEVENT_SEG_SIZE - seg->len;
+		if (n > len)
+			n = len;
+		memcpy(seg->data + seg->len, p, n);
+		seg->len += n;
+		bev->output.len += n;
+		p += n;
+		len -= n;
+	}
+
+	bev->in_cb++;
+	if (bev->high && !bev->above_high && bev->output.len > bev->high) {
+		bev->above_high = 1;
+		if (bev->highcb)
+			bev->highcb(bev, bev->args);
+	}
+	/* outside of callbacks nothing would gather the writes, send now */
+	if (bev->in_cb == 1 && !bev->closing && !(bev->ev->flags & EVENT_WRITE))
+		bufevent_flush(bev);
+	bufevent_leave(bev);
+	return 0;
+}
+
+int rtl_bufevent_flush(struct rtl_bufevent *bev)
+{
+	if (!bev || bev->closing)
+		return -1;
+	bev->in_cb++;
+	bufevent_flush(bev);
+	bufevent_leave(bev);
+	return 0;
+}
+
+size_t rtl_bufevent_output_len(const struct rtl_bufevent *bev)
+{
+	return bev->output.len;
+}
+
+size_t rtl_bufevent_input_len(const struct rtl_bufevent *bev)
+{
+	return bev->input.len;
+}
+
+size_t rtl_bufevent_read(struct rtl_bufevent *bev, void *data, size_t len)
+{
+	char *p = (char *)data;
+	struct rtl_bufseg *seg;
+	size_t copied = 0;
+	size_t n;
+
+	for (seg = bev->input.head; seg && copied < len; seg = seg->next) {
+		n = seg->len - seg->off;
+		if (n > len - copied)
+			n = len - copied;
+		memcpy(p + copied, seg->data + seg->off, n);
+		copied += n;
+	}
+	chain_drain(&bev->input, copied);
+	return copied;
+}
+
+void *rtl_bufevent_peek(struct rtl_bufevent *bev, size_t *len)
+{
+	struct rtl_bufseg *seg = bev->input.head;
+
+	if (!bev->input.len) {
+		*len = 0;
+		return NULL;
+	}
+	*len = seg->len - seg->off;
+	return seg->data + seg->off;
+}
+
+void rtl_bufevent_drain(struct rtl_bufevent *bev, size_t len)
+{
+	chain_drain(&bev->input, len);
+}
@@ -0,0 +1,629 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "rtl_coroutine.h"
+
+#define CO_STACK_POOL_MAX	64
+
+/*
+ * machine context. on x86_64 a context is the saved stack pointer, the
+ * callee-saved registers and the fpu control words live on the stack.
+ */
+#if defined(__x86_64__)
+struct co_ctx {
+	void *sp;
+};
+
+void rtl_co_switch(struct co_ctx *from, struct co_ctx *to)
+	__attribute__ ((visibility("hidden")));
+
+__asm__ (
+	".text\n"
+	".globl rtl_co_switch\n"
+	".hidden rtl_co_switch\n"
+	".type rtl_co_switch, @function\n"
+	"rtl_co_switch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq (%rsi), %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size rtl_co_switch, .-rtl_co_switch\n"
+);
+
+static void co_ctx_make(struct co_ctx *ctx, void *stack, size_t size, void (*entry)(void))
+{
+	uint64_t *sp = (uint64_t *)(((uintptr_t)stack + size) & ~(uintptr_t)15);
+
+	*--sp = 0;					/* return address of entry, never used */
+	*--sp = (uint64_t)entry;	/* popped by ret */
+	sp -= 6;					/* rbp, rbx, r12 - r15 */
+	memset(sp, 0, 6 * sizeof(uint64_t));
+	*--sp = 0x1f80 | ((uint64_t)0x037f << 32);	/* default mxcsr and x87 cw */
+	ctx->sp = sp;
+}
+
+#define co_ctx_switch(from, to)	rtl_co_switch(from, to)
+#else
+#include <ucontext.h>
+
+struct co_ctx {
+	ucontext_t uc;
+};
+
+static void co_ctx_make(struct co_ctx *ctx, void *stack, size_t size, void (*entry)(void))
+{
+	getcontext(&ctx->uc);
+	ctx->uc.uc_stack.ss_sp = stack;
+	ctx->uc.uc_stack.ss_size = size;
+	ctx->uc.uc_link = NULL;
+	makecontext(&ctx->uc, entry, 0);
+}
+
+#define co_ctx_switch(from, to)	swapcontext(&(from)->uc, &(to)->uc)
+#endif
+
+struct co_fd;
+
+struct rtl_coroutine {
+	struct co_ctx ctx;
+	struct rtl_event_base *eb;
+	rtl_coroutine_fn fn;
+	void *args;
+	char *stack;			/* mapping, the lowest page is the guard */
+	size_t stack_size;		/* mapping size */
+	int dead;
+	/* what the coroutine is suspended on */
+	struct rtl_event_timer timer;
+	struct co_fd *wait_cf;
+	int wait_dir;
+	int wait_err;
+};
+
+/* per-fd state, the argument of the fd's slot event */
+struct co_fd {
+	struct rtl_event_base *eb;
+	struct rtl_event *ev;
+	rtl_coroutine_t *waiter[2];		/* indexed by CO_READ / CO_WRITE */
+	int ready[2];					/* an edge came while nobody waited */
+};
+
+#define CO_READ		0
+#define CO_WRITE	1
+
+static __thread rtl_coroutine_t *co_current;
+/* context of the loop, coroutines switch back to it */
+static __thread struct co_ctx co_main;
+static __thread char *stack_pool;
+static __thread int stack_pool_size;
+
+static size_t co_page_size(void)
+{
+	static size_t page;
+
+	if (!page)
+		page = sysconf(_SC_PAGESIZE);
+	return page;
+}
+
+static char *co_stack_alloc(size_t size)
+{
+	char *stack;
+
+	if (size == RTL_COROUTINE_STACK + co_page_size() && stack_pool) {
+		stack = stack_pool;
+		stack_pool = *(char **)(stack + co_page_size());
+		stack_pool_size--;
+		return stack;
+	}
+	stack = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+	if (stack == MAP_FAILED) {
+		fprintf(stderr, "mmap coroutine stack failed: %s\n", strerror(errno));
+		return NULL;
+	}
+	if (mprotect(stack, co_page_size(), PROT_NONE) < 0) {
+		fprintf(stderr, "mprotect stack guard failed: %s\n", strerror(errno));
+		munmap(stack, size);
+		return NULL;
+	}
+	return stack;
+}
+
+static void co_stack_free(char *stack, size_t size)
+{
+	if (size == RTL_COROUTINE_STACK + co_page_size() &&
+		stack_pool_size < CO_STACK_POOL_MAX) {
+		*(char **)(stack + co_page_size()) = stack_pool;
+		stack_pool = stack;
+		stack_pool_size++;
+		return;
+	}
+	munmap(stack, size);
+}
+
+static void co_entry(void)
+{
+	rtl_coroutine_t *co = co_current;
+
+	co->fn(co->args);
+	co->dead = 1;
+	co_ctx_switch(&co->ctx, &co_main);
+}
+
+static void co_resume_task(void *args);
+
+/* run co until it suspends, from the loop only */
+static void co_resume(rtl_coroutine_t *co)
+{
+	if (co_current) {
+		/* coroutines do not nest, let the loop switch to it */
+		rtl_event_base_post(co->eb, co_resume_task, co);
+		return;
+	}
+	co_current = co;
+	co_ctx_switch(&co_main, &co->ctx);
+	co_current = NULL;
+	if (co->dead) {
+		co_stack_free(co->stack, co->stack_size);
+		free(co);
+	}
+}
+
+static void co_resume_task(void *args)
+{
+	co_resume((rtl_coroutine_t *)args);
+}
+
+static void co_suspend(rtl_coroutine_t *co)
+{
+	co_ctx_switch(&co->ctx, &co_main);
+}
+
+/* take the waiter of one direction, so it is resumed only once */
+static rtl_coroutine_t *co_fd_claim(struct co_fd *cf, int dir)
+{
+	rtl_coroutine_t *co = cf->waiter[dir];
+
+	if (co) {
+		cf->waiter[dir] = NULL;
+		co->wait_cf = NULL;
+	}
+	return co;
+}
+
+static void co_timer_cb(struct rtl_event_timer *t, void *args)
+{
+	rtl_coroutine_t *co = (rtl_coroutine_t *)args;
+
+	if (co->wait_cf)
+		co_fd_claim(co->wait_cf, co->wait_dir);
+	co->wait_err = ETIMEDOUT;
+	co_resume(co);
+}
+
+static void co_fd_event(struct co_fd *cf, int dir)
+{
+	rtl_coroutine_t *co = co_fd_claim(cf, dir);
+	int flag = dir == CO_READ ? EVENT_READ : EVENT_WRITE;
+
+	if (co) {
+		/* cf may be gone once the coroutine ran */
+		co_resume(co);
+		return;
+	}
+	/* nobody waits, keep level-triggered backends from repeating it */
+	cf->ready[dir] = 1;
+	rtl_event_mod(cf->eb, cf->ev, cf->ev->flags & ~flag);
+}
+
+static void co_fd_in(struct rtl_event *e, void *args)
+{
+	co_fd_event((struct co_fd *)args, CO_READ);
+}
+
+static void co_fd_out(struct rtl_event *e, void *args)
+{
+	co_fd_event((struct co_fd *)args, CO_WRITE);
+}
+
+static void co_fd_err(struct rtl_event *e, void *args)
+{
+	struct co_fd *cf = (struct co_fd *)args;
+	rtl_coroutine_t *r = co_fd_claim(cf, CO_READ);
+	rtl_coroutine_t *w = co_fd_claim(cf, CO_WRITE);
+
+	cf->ready[CO_READ] = cf->ready[CO_WRITE] = 1;
+	/* both retry their call and see the error */
+	if (r)
+		co_resume(r);
+	if (w)
+		co_resume(w);
+}
+
+static struct co_fd *co_fd_get(struct rtl_event_base *eb, int fd)
+{
+	struct rtl_event *e = rtl_event_lookup(eb, fd);
+	struct co_fd *cf;
+	int flags;
+
+	if (e) {
+		if (e->cbs.ev_in == co_fd_in)
+			return (struct co_fd *)e->cbs.args;
+		/* the fd is already used with plain events */
+		errno = EEXIST;
+		return NULL;
+	}
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || (!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+		return NULL;
+	cf = calloc(1, sizeof(struct co_fd));
+	if (!cf) {
+		fprintf(stderr, "calloc co_fd failed!\n");
+		return NULL;
+	}
+	e = rtl_event_slot_create(eb, fd, co_fd_in, co_fd_out, co_fd_err, cf);
+	if (!e) {
+		free(cf);
+		return NULL;
+	}
+	/* write interest only while a writer waits */
+	e->flags &= ~EVENT_WRITE;
+	if (rtl_event_add(eb, e) < 0) {
+		/* release the slot without closing fd */
+		memset(e, 0, sizeof(*e));
+		free(cf);
+		return NULL;
+	}
+	cf->eb = eb;
+	cf->ev = e;
+	return cf;
+}
+
+/* register fd with the running coroutine's loop, which makes it non-blocking */
+static struct co_fd *co_fd_self(int fd)
+{
+	if (!co_current) {
+		errno = EPERM;
+		return NULL;
+	}
+	return co_fd_get(co_current->eb, fd);
+}
+
+rtl_coroutine_t *rtl_coroutine_create(struct rtl_event_base *eb,
+		rtl_coroutine_fn fn, void *args, size_t stack_size)
+{
+	size_t page = co_page_size();
+	rtl_coroutine_t *co;
+
+	if (!eb || !fn) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return NULL;
+	}
+	if (!stack_size)
+		stack_size = RTL_COROUTINE_STACK;
+	stack_size = (stack_size + page - 1) & ~(page - 1);
+
+	co = calloc(1, sizeof(rtl_coroutine_t));
+	if (!co) {
+		fprintf(stderr, "calloc rtl_coroutine_t failed!\n");
+		return NULL;
+	}
+	co->stack_size = stack_size + page;
+	co->stack = co_stack_alloc(co->stack_size);
+	if (!co->stack) {
+		free(co);
+		return NULL;
+	}
+	co->eb = eb;
+	co->fn = fn;
+	co->args = args;
+	RTL_RB_CLEAR_NODE(&co->timer.node);
+	co->timer.cb = co_timer_cb;
+	co->timer.args = co;
+	co_ctx_make(&co->ctx, co->stack + page, stack_size, co_entry);
+
+	if (rtl_event_base_post(eb, co_resume_task, co) < 0) {
+		co_stack_free(co->stack, co->stack_size);
+		free(co);
+		return NULL;
+	}
+	return co;
+}
+
+rtl_coroutine_t *rtl_coroutine_self(void)
+{
+	return co_current;
+}
+
+void rtl_coroutine_yield(void)
+{
+	rtl_coroutine_t *co = co_current;
+
+	if (!co)
+		return;
+	if (rtl_event_base_post(co->eb, co_resume_task, co) == 0)
+		co_suspend(co);
+}
+
+/* suspend co until its timer fires, or until woken through wait_cf */
+static int co_wait_timed(rtl_coroutine_t *co, int64_t ms)
+{
+	struct timeval tv;
+
+	co->wait_err = 0;
+	if (ms >= 0) {
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000;
+		rtl_event_timer_add(co->eb, &co->timer, &tv, 0);
+	}
+	co_suspend(co);
+	if (rtl_event_timer_pending(&co->timer))
+		rtl_event_timer_del(co->eb, &co->timer);
+	if (co->wait_err) {
+		errno = co->wait_err;
+		return -1;
+	}
+	return 0;
+}
+
+void rtl_coroutine_sleep(int64_t ms)
+{
+	rtl_coroutine_t *co = co_current;
+
+	if (!co || ms < 0)
+		return;
+	co->wait_cf = NULL;
+	co_wait_timed(co, ms);
+}
+
+int rtl_co_wait(int fd, int what, int64_t ms)
+{
+	rtl_coroutine_t *co = co_current;
+	int dir = (what & EVENT_WRITE) ? CO_WRITE : CO_READ;
+	int flag = dir == CO_READ ? EVENT_READ : EVENT_WRITE;
+	struct co_fd *cf;
+
+	if (!(cf = co_fd_self(fd)))
+		return -1;
+	if (cf->ready[dir]) {
+		cf->ready[dir] = 0;
+		return 0;
+	}
+	if (cf->waiter[dir]) {
+		errno = EBUSY;
+		return -1;
+	}
+	if (!(cf->ev->flags & flag) &&
+		rtl_event_mod(co->eb, cf->ev, cf->ev->flags | flag) < 0)
+		return -1;
+	cf->waiter[dir] = co;
+	co->wait_cf = cf;
+	co->wait_dir = dir;
+	return co_wait_timed(co, ms);
+}
+
+ssize_t rtl_co_read(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	if (!co_fd_self(fd))
+		return -1;
+	for (;;) {
+		n = read(fd, buf, len);
+		if (n >= 0)
+			return n;
+		if (errno == EINTR)
+			continue;
+		if ((errno != EAGAIN && errno != EWOULDBLOCK) ||
+			rtl_co_wait(fd, EVENT_READ, -1) < 0)
+			return -1;
+	}
+}
+
+ssize_t rtl_co_write(int fd, const void *buf, size_t len)
+{
+	ssize_t n;
+
+	if (!co_fd_self(fd))
+		return -1;
+	for (;;) {
+		n = write(fd, buf, len);
+		if (n >= 0)
+			return n;
+		if (errno == EINTR)
+			continue;
+		if ((errno != EAGAIN && errno != EWOULDBLOCK) ||
+			rtl_co_wait(fd, EVENT_WRITE, -1) < 0)
+			return -1;
+	}
+}
+
+int rtl_co_recv(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	if (buf == NULL || len == 0) {
+		fprintf(stderr, "%s paraments invalid!\n", __func__);
+		return -1;
+	}
+	if (!co_fd_self(fd))
+		return -1;
+	for (;;) {
+		n = recv(fd, buf, len, 0);
+		if (n >= 0)
+			return n;
+		if (errno == EINTR)
+			continue;
+		if ((errno != EAGAIN && errno != EWOULDBLOCK) ||
+			rtl_co_wait(fd, EVENT_READ, -1) < 0)
+			return -1;
+	}
+}
+
+int rtl_co_recvn(int fd, void *buf, size_t len)
+{
+	char *p = (char *)buf;
+	size_t left = len;
+	int n;
+
+	if (buf == NULL || len == 0) {
+		fprintf(stderr, "%s paraments invalid!\n", __func__);
+		return -1;
+	}
+	while (left > 0) {
+		n = rtl_co_recv(fd, p, left);
+		if (n < 0)
+			return -1;
+		if (n == 0)
+			break;			/* peer closed */
+		left -= n;
+		p += n;
+	}
+	return len - left;
+}
+
+int rtl_co_send(int fd, const void *buf, size_t len)
+{
+	ssize_t n;
+
+	if (buf == NULL || len == 0) {
+		fprintf(stderr, "%s paraments invalid!\n", __func__);
+		return -1;
+	}
+	if (!co_fd_self(fd))
+		return -1;
+	for (;;) {
+		n = send(fd, buf, len, MSG_NOSIGNAL);
+		if (n >= 0)
+			return n;
+		if (errno == EINTR)
+			continue;
+		if ((errno != EAGAIN && errno != EWOULDBLOCK) ||
+			rtl_co_wait(fd, EVENT_WRITE, -1) < 0)
+			return -1;
+	}
+}
+
+int rtl_co_sendn(int fd, const void *buf, size_t len)
+{
+	const char *p = (const char *)buf;
+	size_t left = len;
+	int n;
+
+	if (buf == NULL || len == 0) {
+		fprintf(stderr, "%s paraments invalid!\n", __func__);
+		return -1;
+	}
+	while (left > 0) {
+		n = rtl_co_send(fd, p, left);
+		if (n < 0)
+			return -1;
+		if (n == 0)
+			break;
+		left -= n;
+		p += n;
+	}
+	return len - left;
+}
+
+int rtl_co_accept(int fd, uint32_t *ip, uint16_t *port)
+{
+	struct sockaddr_in si;
+	socklen_t len;
+	int afd;
+
+	if (!co_fd_self(fd))
+		return -1;
+	for (;;) {
+		len = sizeof(si);
+		afd = accept4(fd, (struct sockaddr *)&si, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (afd >= 0)
+			break;
+		if (errno == EINTR || errno == ECONNABORTED)
+			continue;
+		if ((errno != EAGAIN && errno != EWOULDBLOCK) ||
+			rtl_co_wait(fd, EVENT_READ, -1) < 0)
+			return -1;
+	}
+	if (ip)
+		*ip = si.sin_addr.s_addr;
+	if (port)
+		*port = ntohs(si.sin_port);
+	return afd;
+}
+
+int rtl_co_connect(int fd, const struct sockaddr *addr, socklen_t len)
+{
+	socklen_t errlen = sizeof(int);
+	int err = 0;
+
+	if (!co_fd_self(fd))
+		return -1;
+	if (connect(fd, addr, len) == 0)
+		return 0;
+	if (errno != EINPROGRESS)
+		return -1;
+	if (rtl_co_wait(fd, EVENT_WRITE, -1) < 0)
+		return -1;
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0)
+		return -1;
+	if (err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+void rtl_co_close(int fd)
+{
+	rtl_coroutine_t *co;
+	struct rtl_event *e;
+	struct co_fd *cf;
+	int dir;
+
+	e = co_current ? rtl_event_lookup(co_current->eb, fd) : NULL;
+	if (!e || e->cbs.ev_in != co_fd_in) {
+		close(fd);
+		return;
+	}
+	cf = (struct co_fd *)e->cbs.args;
+	/* coroutines still waiting on fd fail with EBADF */
+	for (dir = CO_READ; dir <= CO_WRITE; dir++) {
+		if ((co = co_fd_claim(cf, dir))) {
+			co->wait_err = EBADF;
+			/* its timer must not resume it a second time */
+			if (rtl_event_timer_pending(&co->timer))
+				rtl_event_timer_del(co->eb, &co->timer);
+			rtl_event_base_post(co->eb, co_resume_task, co);
+		}
+	}
+	rtl_event_slot_destroy(co_current->eb, e);
+	free(cf);
+}
@@ -8,12 +8,18 @@
 
 #include "rtl_event.h"
 
-#define EPOLL_MAX_NEVENT			512
+/* the ready array adapts between these sizes to the observed load */
+#define EPOLL_MIN_NEVENT			32
+#define EPOLL_MAX_NEVENT			4096
+#define EPOLL_SHRINK_ROUNDS			64
 #define MAX_SECONDS_IN_MSEC_LONG	(((LONG_MAX) - 999) / 1000)
 
 struct epoll_ctx {
 	int epfd;
 	int nevents;
+	int idle_rounds;
+	int ready_next;				/* first ready entry not yet dispatched */
+	int ready_n;				/* ready entries of the running dispatch */
 	struct epoll_event *events;
 };
 
@@ -34,8 +40,8 @@ static void *epoll_init(void)
 		goto err;
 	}
 	ec->epfd = fd;
-	ec->nevents = EPOLL_MAX_NEVENT;
-	ec->events = calloc(EPOLL_MAX_NEVENT, sizeof(struct epoll_event));
+	ec->nevents = EPOLL_MIN_NEVENT;
+	ec->events = calloc(EPOLL_MIN_NEVENT, sizeof(struct epoll_event));
 	if (!ec->events) {
 		perror("calloc");
 		free(ec);
@@ -54,27 +60,70 @@ static void epoll_deinit(void *ctx)
 	if (!ec)
 		return;
 
+	close(ec->epfd);
 	free(ec->events);
 	free(ec);
 }
 
-static int epoll_add(struct rtl_event_base *eb, struct rtl_event *e)
+/*
+ * double the ready array when a wakeup filled it, so the next epoll_wait
+ * drains every ready fd, and halve it after EPOLL_SHRINK_ROUNDS wakeups
+ * that used less than a quarter of it. resizing is the only allocation
+ * done by dispatch and it is skipped when realloc fails.
+ */
+static void epoll_resize(struct epoll_ctx *ec, int n)
 {
-	struct epoll_ctx *ec = (struct epoll_ctx *)eb->ctx;
-	struct epoll_event epev;
+	struct epoll_event *events;
+	int nevents = ec->nevents;
+
+	if (n == ec->nevents && nevents < EPOLL_MAX_NEVENT) {
+		nevents <<= 1;
+		ec->idle_rounds = 0;
+	} else if (n < (ec->nevents >> 2) && nevents > EPOLL_MIN_NEVENT) {
+		if (++ec->idle_rounds < EPOLL_SHRINK_ROUNDS)
+			return;
+		nevents >>= 1;
+		ec->idle_rounds = 0;
+	} else {
+		ec->idle_rounds = 0;
+		return;
+	}
+	events = realloc(ec->events, nevents * sizeof(struct epoll_event));
+	if (!events)
+		return;
+	ec->events = events;
+	ec->nevents = nevents;
+}
 
-	memset(&epev, 0, sizeof(epev));
+static void epoll_event_set(struct epoll_event *epev, struct rtl_event *e)
+{
+	memset(epev, 0, sizeof(*epev));
 	if (e->flags & EVENT_READ)
-		epev.events |= EPOLLIN;
+		epev->events |= EPOLLIN;
 	if (e->flags & EVENT_WRITE)
-		epev.events |= EPOLLOUT;
+		epev->events |= EPOLLOUT;
+	if (e->flags & EVENT_ET)
+		epev->events |= EPOLLET;
 	if (e->flags & EVENT_ERROR)
-		epev.events |= EPOLLERR;
-	if (e->flags & EVENT_CLOSED)
-		epev.events |= EPOLLRDHUP;
-	epev.events |= EPOLLET;
-	epev.data.ptr = (void *)e;
+		epev->events |= EPOLLERR;
+	if (e->flags & EVENT_EXCLUSIVE) {
+		/* EPOLLEXCLUSIVE can not be combined with EPOLLRDHUP or EPOLLONESHOT */
+		epev->events |= EPOLLEXCLUSIVE;
+	} else {
+		if (e->flags & EVENT_CLOSED)
+			epev->events |= EPOLLRDHUP;
+		if (!(e->flags & EVENT_PERSIST))
+			epev->events |= EPOLLONESHOT;
+	}
+	epev->data.ptr = (void *)e;
+}
+
+static int epoll_add(struct rtl_event_base *eb, struct rtl_event *e)
+{
+	struct epoll_ctx *ec = (struct epoll_ctx *)eb->ctx;
+	struct epoll_event epev;
 
+	epoll_event_set(&epev, e);
 	if (epoll_ctl(ec->epfd, EPOLL_CTL_ADD, e->evfd, &epev) < 0) {
 		perror("epoll_ctl");
 		return -1;
@@ -82,9 +131,42 @@ static int epoll_add(struct rtl_event_base *eb, struct rtl_event *e)
 	return 0;
 }
 
+static int epoll_mod(struct rtl_event_base *eb, struct rtl_event *e)
+{
+	struct epoll_ctx *ec = (struct epoll_ctx *)eb->ctx;
+	struct epoll_event epev;
+
+	epoll_event_set(&epev, e);
+	/* EPOLLEXCLUSIVE can neither be set nor cleared by EPOLL_CTL_MOD */
+	if (!(e->flags & EVENT_EXCLUSIVE)) {
+		if (epoll_ctl(ec->epfd, EPOLL_CTL_MOD, e->evfd, &epev) == 0)
+			return 0;
+		if (errno != EINVAL) {
+			perror("epoll_ctl");
+			return -1;
+		}
+	}
+	if (epoll_ctl(ec->epfd, EPOLL_CTL_DEL, e->evfd, NULL) < 0 ||
+		epoll_ctl(ec->epfd, EPOLL_CTL_ADD, e->evfd, &epev) < 0) {
+		perror("epoll_ctl");
+		return -1;
+	}
+	return 0;
+}
+
 static int epoll_del(struct rtl_event_base *eb, struct rtl_event *e)
 {
 	struct epoll_ctx *ec = (struct epoll_ctx *)eb->ctx;
+	int i;
+
+	/*
+	 * a callback may delete and free another event that is still waiting
+	 * further down the ready array, drop those entries before it goes.
+	 */
+	for (i = ec->ready_next; i < ec->ready_n; i++) {
+		if (ec->events[i].data.ptr == e)
+			ec->events[i].data.ptr = NULL;
+	}
 	if (epoll_ctl(ec->epfd, EPOLL_CTL_DEL, e->evfd, NULL) < 0) {
 		perror("epoll_ctl");
 		return -1;
@@ -115,28 +197,43 @@ static int epoll_dispatch(struct rtl_event_base *eb, struct timeval *tv)
 		}
 		return 0;
 	}
-	if (n == 0) {
-		printf("epoll_wait timeout\n");
-		return 0;
-	}
+	rtl_event_base_ready(eb, n);
+	epop->ready_n = n;
 	for (i = 0; i < n; i++) {
-		int what = events[i].events;
+		int what = 0;
 		struct rtl_event *e = (struct rtl_event *)events[i].data.ptr;
 
-		if (what & EPOLLIN)
-			e->evcb->ev_in(e, (void *)e->evcb->args);
-		if (what & EPOLLOUT)
-			e->evcb->ev_out(e, (void *)e->evcb->args);
-		if (what & EPOLLERR)
-			e->evcb->ev_err(e, (void *)e->evcb->args);
+		epop->ready_next = i + 1;
+		if (!e)
+			continue;
+		if (events[i].events & EPOLLIN)
+			what |= EVENT_READ;
+		if (events[i].events & EPOLLOUT)
+			what |= EVENT_WRITE;
+		if (events[i].events & EPOLLERR)
+			what |= EVENT_ERROR;
+		/*
+		 * a hangup is reported whether asked for or not, on every wait in
+		 * level-triggered mode, so it must reach a callback that can close
+		 * the fd or the loop spins on it.
+		 */
+		if (events[i].events & EPOLLHUP)
+			what |= EVENT_READ | EVENT_ERROR;
+		if ((events[i].events & EPOLLRDHUP) && (e->flags & EVENT_CLOSED))
+			what |= EVENT_READ | EVENT_ERROR;
+		rtl_event_base_active(eb, e, what);
 	}
-	return 0;
+	epop->ready_next = epop->ready_n = 0;
+	epoll_resize(epop, n);
+	return n;
 }
 
-struct rtl_event_ops rtl_epoll_ops = {
+const struct rtl_event_ops rtl_epoll_ops = {
+	.name     = "epoll",
 	.init     = epoll_init,
 	.deinit   = epoll_deinit,
 	.add      = epoll_add,
 	.del      = epoll_del,
+	.mod      = epoll_mod,
 	.dispatch = epoll_dispatch,
 };
@@ -1,50 +1,280 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
-#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 
 #include "rtl_event.h"
 
 extern const struct rtl_event_ops rtl_epoll_ops;
+extern const struct rtl_event_ops rtl_uring_ops;
 
 static const struct rtl_event_ops *event_ops[] = {
 	&rtl_epoll_ops,
+	&rtl_uring_ops,
 	NULL
 };
 
+static void post_push(struct rtl_event_base *eb, struct rtl_event_task *task)
+{
+	struct rtl_event_task *prev;
+
+	__atomic_store_n(&task->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&eb->post_head, task, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, task, __ATOMIC_RELEASE);
+}
+
+/*
+ * Vyukov's intrusive MPSC pop, only called by the loop thread. NULL is
+ * returned when the queue is empty or a producer is between its exchange
+ * and its link, such a producer notifies the loop after linking.
+ */
+static struct rtl_event_task *post_pop(struct rtl_event_base *eb)
+{
+	struct rtl_event_task *tail = eb->post_tail;
+	struct rtl_event_task *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if (tail == &eb->post_stub) {
+		if (!next)
+			return NULL;
+		eb->post_tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		eb->post_tail = next;
+		return tail;
+	}
+	if (tail != __atomic_load_n(&eb->post_head, __ATOMIC_ACQUIRE))
+		return NULL;
+	post_push(eb, &eb->post_stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		eb->post_tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
 static void event_in(struct rtl_event *event, void *args)
 {
+	struct rtl_event_base *eb = (struct rtl_event_base *)args;
+	struct rtl_event_task *task;
+	uint64_t cnt;
+
+	/* reset the eventfd counter, level-triggered backends would spin on it */
+	if (read(event->evfd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+		perror("read error");
+	/* re-enable notification before draining so no post is missed */
+	__atomic_store_n(&eb->post_notified, 0, __ATOMIC_SEQ_CST);
+	while ((task = post_pop(eb))) {
+		task->fn(task->args);
+		free(task);
+	}
+}
+
+static uint64_t event_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int latency_bucket(uint64_t usec)
+{
+	int b;
+
+	if (!usec)
+		return 0;
+	b = 64 - __builtin_clzll(usec);
+	return b < RTL_EVENT_HIST_BUCKETS ? b : RTL_EVENT_HIST_BUCKETS - 1;
+}
+
+/* account one callback that became runnable at ready and ran start..end */
+static void latency_cb(struct rtl_event_latency *lat, int fd, void *cb,
+		uint64_t ready, uint64_t start, uint64_t end)
+{
+	uint64_t lag = start > ready ? start - ready : 0;
+	struct rtl_event_slow *slow;
+
+	lat->cb_hist[latency_bucket(end - start)]++;
+	lat->lag_hist[latency_bucket(lag)]++;
+	if (lag > lat->lag_max)
+		lat->lag_max = lag;
+	if (end - start >= lat->slow_usec) {
+		slow = &lat->slow[lat->nslow++ % RTL_EVENT_SLOW_RECORDS];
+		slow->fd = fd;
+		slow->cb = cb;
+		slow->usec = end - start;
+		slow->when = end;
+	}
+}
+
+static void timer_insert(struct rtl_event_base *eb, struct rtl_event_timer *t)
+{
+	struct rtl_rb_node **p = &eb->timers.rb_node;
+	struct rtl_rb_node *parent = NULL;
+	int leftmost = 1;
+
+	while (*p) {
+		struct rtl_event_timer *entry;
+
+		parent = *p;
+		entry = rtl_rb_entry(parent, struct rtl_event_timer, node);
+		if (t->expire < entry->expire) {
+			p = &parent->rb_left;
+		} else {
+			p = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+	if (leftmost)
+		eb->timer_first = &t->node;
+	rtl_rb_link_node(&t->node, parent, p);
+	rtl_rb_insert_color(&t->node, &eb->timers);
+	t->base = eb;
+}
+
+static void timer_erase(struct rtl_event_base *eb, struct rtl_event_timer *t)
+{
+	if (eb->timer_first == &t->node)
+		eb->timer_first = rtl_rb_next(&t->node);
+	rtl_rb_erase(&t->node, &eb->timers);
+	RTL_RB_CLEAR_NODE(&t->node);
+	t->base = NULL;
+}
+
+/* return the time until the nearest deadline, or NULL to block forever */
+static struct timeval *timer_timeout(struct rtl_event_base *eb, struct timeval *tv)
+{
+	struct rtl_event_timer *t;
+	uint64_t now, delta;
+
+	if (!eb->timer_first)
+		return NULL;
+	t = rtl_rb_entry(eb->timer_first, struct rtl_event_timer, node);
+	now = event_now();
+	delta = t->expire > now ? t->expire - now : 0;
+	tv->tv_sec = delta / 1000000;
+	tv->tv_usec = delta % 1000000;
+	return tv;
+}
+
+static void timer_process(struct rtl_event_base *eb)
+{
+	struct rtl_event_timer *t;
+	void (*cb)(struct rtl_event_timer *, void *);
+	uint64_t now, expire, start;
+
+	if (!eb->timer_first)
+		return;
+	now = event_now();
+	while (eb->timer_first) {
+		t = rtl_rb_entry(eb->timer_first, struct rtl_event_timer, node);
+		if (t->expire > now)
+			break;
+		timer_erase(eb, t);
+		expire = t->expire;
+		cb = t->cb;
+		if (t->flags & EVENT_PERSIST) {
+			/* re-arm before the callback, so it is free to del the timer */
+			t->expire += t->interval;
+			if (t->expire <= now)
+				t->expire = now + t->interval;
+			timer_insert(eb, t);
+		}
+		if (!eb->lat) {
+			cb(t, t->args);
+			continue;
+		}
+		/* t may be freed by its callback */
+		start = event_now();
+		cb(t, t->args);
+		latency_cb(eb->lat, -1, (void *)cb, expire, start, event_now());
+	}
+}
+
+static int event_base_once(struct rtl_event_base *eb)
+{
+	struct timeval tv;
+	int ret;
+
+	eb->wake_usec = 0;
+	ret = eb->evop->dispatch(eb, timer_timeout(eb, &tv));
+	timer_process(eb);
+	if (eb->wake_usec) {
+		uint64_t usec = event_now() - eb->wake_usec;
+
+		eb->stat_cb_usec += usec;
+		if (eb->lat)
+			eb->lat->iter_hist[latency_bucket(usec)]++;
+	}
+	return ret;
 }
 
 struct rtl_event_base *rtl_event_base_create(void)
+{
+	return rtl_event_base_create_backend(NULL);
+}
+
+struct rtl_event_base *rtl_event_base_create_backend(const char *backend)
 {
 	int i;
-	int fds[2];
+	int fd;
 	struct rtl_event_base *eb = NULL;
 
-	if (pipe(fds)) {
-		perror("pipe failed");
+	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		perror("eventfd failed");
 		return NULL;
 	}
 	eb = calloc(1, sizeof(struct rtl_event_base));
 	if (!eb) {
 		fprintf(stderr, "malloc rtl_event_base failed!\n");
-		close(fds[0]);
-		close(fds[1]);
+		close(fd);
 		return NULL;
 	}
 
 	for (i = 0; event_ops[i]; i++) {
+		if (backend && strcmp(backend, event_ops[i]->name))
+			continue;
 		eb->ctx = event_ops[i]->init();
-		eb->evop = event_ops[i];
+		if (eb->ctx) {
+			eb->evop = event_ops[i];
+			break;
+		}
+	}
+	if (!eb->evop) {
+		fprintf(stderr, "no usable event backend%s%s\n",
+				backend ? ": " : "", backend ? backend : "");
+		close(fd);
+		free(eb);
+		return NULL;
 	}
 	eb->loop = 1;
-	eb->rfd = fds[0];
-	eb->wfd = fds[1];
-	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	eb->wakefd = fd;
+	eb->timers = RTL_RB_ROOT;
+	eb->timer_first = NULL;
+	eb->post_head = &eb->post_stub;
+	eb->post_tail = &eb->post_stub;
+	eb->sigfd = -1;
+	sigemptyset(&eb->sigmask);
+	eb->stat_since = event_now();
 
-	struct rtl_event *e = rtl_event_create(eb->rfd, event_in, NULL, NULL, NULL);
-	rtl_event_add(eb, e);
+	eb->wakeev = rtl_event_create(fd, event_in, NULL, NULL, eb);
+	if (!eb->wakeev || rtl_event_add(eb, eb->wakeev) < 0) {
+		if (eb->wakeev)
+			rtl_event_destroy(eb->wakeev);
+		else
+			close(fd);
+		eb->evop->deinit(eb->ctx);
+		free(eb);
+		return NULL;
+	}
 
 	return eb;
 }
@@ -53,19 +283,159 @@ void rtl_event_base_destroy(struct rtl_event_base *eb)
 {
 	if (!eb)
 		return;
+	struct rtl_event_task *task;
+	int i;
+
 	rtl_event_base_loop_break(eb);
-	close(eb->rfd);
-	close(eb->wfd);
+	/* pending timers are detached, they may outlive the base */
+	while (eb->timer_first)
+		timer_erase(eb, rtl_rb_entry(eb->timer_first,
+					struct rtl_event_timer, node));
+	/* tasks posted but never run are dropped */
+	while ((task = post_pop(eb)))
+		free(task);
+	rtl_event_del(eb, eb->wakeev);
+	rtl_event_destroy(eb->wakeev);
+	if (eb->sigev) {
+		rtl_event_del(eb, eb->sigev);
+		rtl_event_destroy(eb->sigev);
+		sigprocmask(SIG_UNBLOCK, &eb->sigmask, NULL);
+	}
+	free(eb->sighandlers);
+	free(eb->lat);
+	for (i = 0; i < eb->nslab; i++)
+		free(eb->slab[i]);
+	free(eb->slab);
 	eb->evop->deinit(eb->ctx);
 	free(eb);
 }
 
+const char *rtl_event_base_backend(const struct rtl_event_base *eb)
+{
+	return eb->evop->name;
+}
+
+void rtl_event_base_stats(const struct rtl_event_base *eb, struct rtl_event_stats *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->wakeups = eb->stat_wakeups;
+	st->events = eb->stat_events;
+	st->cb_usec = eb->stat_cb_usec;
+	st->uptime_usec = event_now() - eb->stat_since;
+	if (st->wakeups)
+		st->events_per_wakeup = (double)st->events / st->wakeups;
+	if (st->uptime_usec)
+		st->wakeups_per_sec = st->wakeups * 1000000.0 / st->uptime_usec;
+}
+
+void rtl_event_base_stats_reset(struct rtl_event_base *eb)
+{
+	eb->stat_wakeups = 0;
+	eb->stat_events = 0;
+	eb->stat_cb_usec = 0;
+	eb->stat_since = event_now();
+}
+
+void rtl_event_base_ready(struct rtl_event_base *eb, int nready)
+{
+	eb->wake_usec = event_now();
+	eb->stat_wakeups++;
+	eb->stat_events += nready;
+}
+
+static void event_active_latency(struct rtl_event_base *eb, struct rtl_event *e,
+		int what)
+{
+	struct rtl_event_cbs *evcb = e->evcb;
+	void (*cbs[3])(struct rtl_event *, void *);
+	void *args = evcb->args;
+	uint64_t start;
+	int fd = e->evfd;
+	int i;
+
+	cbs[0] = (what & EVENT_READ) ? evcb->ev_in : NULL;
+	cbs[1] = (what & EVENT_WRITE) ? evcb->ev_out : NULL;
+	cbs[2] = (what & EVENT_ERROR) ? evcb->ev_err : NULL;
+	for (i = 0; i < 3 && eb->active == e; i++) {
+		if (!cbs[i])
+			continue;
+		start = event_now();
+		cbs[i](e, args);
+		latency_cb(eb->lat, fd, (void *)cbs[i], eb->wake_usec, start, event_now());
+	}
+}
+
+void rtl_event_base_active(struct rtl_event_base *eb, struct rtl_event *e, int what)
+{
+	struct rtl_event_cbs *evcb = e->evcb;
+
+	/* a slot destroyed by an earlier callback of the same wakeup */
+	if (!evcb)
+		return;
+	/*
+	 * a callback may delete and free e, rtl_event_del clears eb->active
+	 * so the remaining callbacks are skipped without touching e again.
+	 */
+	eb->active = e;
+	if (eb->lat) {
+		event_active_latency(eb, e, what);
+	} else {
+		if ((what & EVENT_READ) && evcb->ev_in)
+			evcb->ev_in(e, (void *)evcb->args);
+		if (eb->active == e && (what & EVENT_WRITE) && evcb->ev_out)
+			evcb->ev_out(e, (void *)evcb->args);
+		if (eb->active == e && (what & EVENT_ERROR) && evcb->ev_err)
+			evcb->ev_err(e, (void *)evcb->args);
+	}
+	eb->active = NULL;
+}
+
+int rtl_event_base_instrument(struct rtl_event_base *eb, int enable,
+		uint64_t slow_usec)
+{
+	if (!eb)
+		return -1;
+	if (!enable) {
+		free(eb->lat);
+		eb->lat = NULL;
+		return 0;
+	}
+	if (!eb->lat) {
+		eb->lat = calloc(1, sizeof(struct rtl_event_latency));
+		if (!eb->lat) {
+			fprintf(stderr, "calloc rtl_event_latency failed!\n");
+			return -1;
+		}
+	}
+	eb->lat->slow_usec = slow_usec;
+	return 0;
+}
+
+int rtl_event_base_latency(const struct rtl_event_base *eb,
+		struct rtl_event_latency *lat)
+{
+	if (!eb || !eb->lat)
+		return -1;
+	memcpy(lat, eb->lat, sizeof(*lat));
+	return 0;
+}
+
+void rtl_event_base_latency_reset(struct rtl_event_base *eb)
+{
+	uint64_t slow_usec;
+
+	if (!eb || !eb->lat)
+		return;
+	slow_usec = eb->lat->slow_usec;
+	memset(eb->lat, 0, sizeof(*eb->lat));
+	eb->lat->slow_usec = slow_usec;
+}
+
 int rtl_event_base_loop(struct rtl_event_base *eb)
 {
-	const struct rtl_event_ops *evop = eb->evop;
 	int ret;
 	while (eb->loop) {
-		ret = evop->dispatch(eb, NULL);
+		ret = event_base_once(eb);
 		if (ret < 0) {
 			fprintf(stderr, "dispatch failed\n");
 		}
@@ -76,49 +446,58 @@ int rtl_event_base_loop(struct rtl_event_base *eb)
 
 int rtl_event_base_wait(struct rtl_event_base *eb)
 {
-	const struct rtl_event_ops *evop = eb->evop;
-	return evop->dispatch(eb, NULL);
+	return event_base_once(eb);
 }
 
 void rtl_event_base_loop_break(struct rtl_event_base *eb)
 {
-	char buf[1];
-	buf[0] = 0;
 	eb->loop = 0;
-	if (1 != write(eb->wfd, buf, 1))
-		perror("write error");
+	rtl_event_base_signal(eb);
 }
 
 void rtl_event_base_signal(struct rtl_event_base *eb)
 {
-	char buf[1];
-	buf[0] = 0;
-	if (1 != write(eb->wfd, buf, 1))
+	uint64_t one = 1;
+	if (sizeof(one) != write(eb->wakefd, &one, sizeof(one)))
 		perror("write error");
 }
 
-struct rtl_event *rtl_event_create(int fd,
+int rtl_event_base_post(struct rtl_event_base *eb, void (*fn)(void *), void *args)
+{
+	struct rtl_event_task *task;
+
+	if (!eb || !fn) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d paraments is NULL\n", __func__, __LINE__);
+#endif
+		return -1;
+	}
+	task = malloc(sizeof(struct rtl_event_task));
+	if (!task) {
+		fprintf(stderr, "malloc rtl_event_task failed!\n");
+		return -1;
+	}
+	task->fn = fn;
+	task->args = args;
+	post_push(eb, task);
+	/* only the first post after a drain has to wake the loop up */
+	if (!__atomic_exchange_n(&eb->post_notified, 1, __ATOMIC_SEQ_CST))
+		rtl_event_base_signal(eb);
+	return 0;
+}
+
+static void event_init(struct rtl_event *e, int fd,
 		void (*ev_in)(struct rtl_event *, void *),
 		void (*ev_out)(struct rtl_event *, void *),
 		void (*ev_err)(struct rtl_event *, void *),
 		void *args)
 {
-	int flags = 0;
-	struct rtl_event *e = calloc(1, sizeof(struct rtl_event));
-	if (!e) {
-		fprintf(stderr, "calloc rtl_event failed!\n");
-		return NULL;
-	}
-	struct rtl_event_cbs *evcb = calloc(1, sizeof(struct rtl_event_cbs));
-	if (!evcb) {
-		fprintf(stderr, "calloc rtl_event failed!\n");
-		free(e);
-		return NULL;
-	}
-	evcb->ev_in = ev_in;
-	evcb->ev_out = ev_out;
-	evcb->ev_err = ev_err;
-	evcb->args = args;
+	int flags = EVENT_PERSIST | EVENT_ET;
+
+	e->cbs.ev_in = ev_in;
+	e->cbs.ev_out = ev_out;
+	e->cbs.ev_err = ev_err;
+	e->cbs.args = args;
 	if (ev_in)
 		flags |= EVENT_READ;
 	if (ev_out)
@@ -128,8 +507,21 @@ struct rtl_event *rtl_event_create(int fd,
 
 	e->evfd = fd;
 	e->flags = flags;
-	e->evcb = evcb;
+	e->evcb = &e->cbs;
+}
 
+struct rtl_event *rtl_event_create(int fd,
+		void (*ev_in)(struct rtl_event *, void *),
+		void (*ev_out)(struct rtl_event *, void *),
+		void (*ev_err)(struct rtl_event *, void *),
+		void *args)
+{
+	struct rtl_event *e = calloc(1, sizeof(struct rtl_event));
+	if (!e) {
+		fprintf(stderr, "calloc rtl_event failed!\n");
+		return NULL;
+	}
+	event_init(e, fd, ev_in, ev_out, ev_err, args);
 	return e;
 }
 
@@ -137,11 +529,81 @@ void rtl_event_destroy(struct rtl_event *e)
 {
 	if (!e)
 		return;
-	free(e->evcb);
+	/* the backend must forget e before its fd can be reused */
+	if (e->base)
+		rtl_event_del(e->base, e);
 	close(e->evfd);
 	free(e);
 }
 
+struct rtl_event *rtl_event_slot_create(struct rtl_event_base *eb, int fd,
+		void (*ev_in)(struct rtl_event *, void *),
+		void (*ev_out)(struct rtl_event *, void *),
+		void (*ev_err)(struct rtl_event *, void *),
+		void *args)
+{
+	int chunk = fd >> RTL_EVENT_SLAB_SHIFT;
+	struct rtl_event *e;
+
+	if (!eb || fd < 0) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return NULL;
+	}
+	if (chunk >= eb->nslab) {
+		int n = eb->nslab ? eb->nslab : 4;
+		struct rtl_event **slab;
+
+		while (n <= chunk)
+			n <<= 1;
+		slab = realloc(eb->slab, n * sizeof(struct rtl_event *));
+		if (!slab) {
+			fprintf(stderr, "realloc event slab failed!\n");
+			return NULL;
+		}
+		memset(slab + eb->nslab, 0, (n - eb->nslab) * sizeof(struct rtl_event *));
+		eb->slab = slab;
+		eb->nslab = n;
+	}
+	if (!eb->slab[chunk]) {
+		eb->slab[chunk] = calloc(RTL_EVENT_SLAB_CHUNK, sizeof(struct rtl_event));
+		if (!eb->slab[chunk]) {
+			fprintf(stderr, "calloc event slab chunk failed!\n");
+			return NULL;
+		}
+	}
+	e = &eb->slab[chunk][fd & (RTL_EVENT_SLAB_CHUNK - 1)];
+	if (e->evcb) {
+		errno = EEXIST;
+		return NULL;
+	}
+	event_init(e, fd, ev_in, ev_out, ev_err, args);
+	return e;
+}
+
+void rtl_event_slot_destroy(struct rtl_event_base *eb, struct rtl_event *e)
+{
+	if (!e)
+		return;
+	if (e->base)
+		rtl_event_del(eb, e);
+	close(e->evfd);
+	/* a NULL evcb marks the slot free */
+	memset(e, 0, sizeof(*e));
+}
+
+struct rtl_event *rtl_event_lookup(struct rtl_event_base *eb, int fd)
+{
+	struct rtl_event *e;
+	int chunk = fd >> RTL_EVENT_SLAB_SHIFT;
+
+	if (fd < 0 || chunk >= eb->nslab || !eb->slab[chunk])
+		return NULL;
+	e = &eb->slab[chunk][fd & (RTL_EVENT_SLAB_CHUNK - 1)];
+	return e->evcb ? e : NULL;
+}
+
 int rtl_event_add(struct rtl_event_base *eb, struct rtl_event *e)
 {
 	if (!e || !eb) {
@@ -150,7 +612,10 @@ int rtl_event_add(struct rtl_event_base *eb, struct rtl_event *e)
 #endif
 		return -1;
 	}
-	return eb->evop->add(eb, e);
+	if (eb->evop->add(eb, e) < 0)
+		return -1;
+	e->base = eb;
+	return 0;
 }
 
 int rtl_event_del(struct rtl_event_base *eb, struct rtl_event *e)
@@ -161,5 +626,186 @@ int rtl_event_del(struct rtl_event_base *eb, struct rtl_event *e)
 #endif
 		return -1;
 	}
+	if (eb->active == e)
+		eb->active = NULL;
+	e->base = NULL;
 	return eb->evop->del(eb, e);
 }
+
+int rtl_event_mod(struct rtl_event_base *eb, struct rtl_event *e, int flags)
+{
+	if (!e || !eb) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d paraments is NULL\n", __func__, __LINE__);
+#endif
+		return -1;
+	}
+	e->flags = flags;
+	return eb->evop->mod(eb, e);
+}
+
+struct rtl_event_timer *rtl_event_timer_create(
+		void (*cb)(struct rtl_event_timer *, void *), void *args)
+{
+	struct rtl_event_timer *t;
+
+	if (!cb)
+		return NULL;
+	t = calloc(1, sizeof(struct rtl_event_timer));
+	if (!t) {
+		fprintf(stderr, "calloc rtl_event_timer failed!\n");
+		return NULL;
+	}
+	RTL_RB_CLEAR_NODE(&t->node);
+	t->cb = cb;
+	t->args = args;
+	return t;
+}
+
+void rtl_event_timer_destroy(struct rtl_event_timer *t)
+{
+	if (!t)
+		return;
+	if (rtl_event_timer_pending(t))
+		timer_erase(t->base, t);
+	free(t);
+}
+
+int rtl_event_timer_add(struct rtl_event_base *eb, struct rtl_event_timer *t,
+		const struct timeval *tv, int flags)
+{
+	uint64_t timeout;
+
+	if (!eb || !t || !tv) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d paraments is NULL\n", __func__, __LINE__);
+#endif
+		return -1;
+	}
+	/* a pending timer may be moved to another base */
+	if (rtl_event_timer_pending(t))
+		timer_erase(t->base, t);
+
+	timeout = (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+	t->flags = EVENT_TIMEOUT | (flags & EVENT_PERSIST);
+	/* a zero interval would make a persistent timer fire forever */
+	t->interval = timeout ? timeout : 1;
+	t->expire = event_now() + timeout;
+	timer_insert(eb, t);
+	return 0;
+}
+
+int rtl_event_timer_del(struct rtl_event_base *eb, struct rtl_event_timer *t)
+{
+	if (!eb || !t) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d paraments is NULL\n", __func__, __LINE__);
+#endif
+		return -1;
+	}
+	if (rtl_event_timer_pending(t))
+		timer_erase(t->base, t);
+	return 0;
+}
+
+int rtl_event_timer_pending(const struct rtl_event_timer *t)
+{
+	return !RTL_RB_EMPTY_NODE(&t->node);
+}
+
+static void signal_in(struct rtl_event *event, void *args)
+{
+	struct rtl_event_base *eb = (struct rtl_event_base *)args;
+	struct signalfd_siginfo si[16];
+	struct rtl_event_sighandler *h;
+	ssize_t n;
+	int i;
+
+	for (;;) {
+		n = read(event->evfd, si, sizeof(si));
+		if (n <= 0) {
+			if (n < 0 && errno != EAGAIN && errno != EINTR)
+				perror("read signalfd");
+			if (n < 0 && errno == EINTR)
+				continue;
+			return;
+		}
+		for (i = 0; i < n / (ssize_t)sizeof(si[0]); i++) {
+			h = &eb->sighandlers[si[i].ssi_signo];
+			if (h->cb)
+				h->cb(eb, si[i].ssi_signo, h->args);
+		}
+	}
+}
+
+int rtl_event_signal_add(struct rtl_event_base *eb, int signo,
+		rtl_event_signal_cb cb, void *args)
+{
+	sigset_t set;
+	int fd;
+
+	if (!eb || !cb || signo <= 0 || signo >= _NSIG) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return -1;
+	}
+	if (!eb->sighandlers) {
+		eb->sighandlers = calloc(_NSIG, sizeof(struct rtl_event_sighandler));
+		if (!eb->sighandlers) {
+			fprintf(stderr, "calloc rtl_event_sighandler failed!\n");
+			return -1;
+		}
+	}
+
+	sigemptyset(&set);
+	sigaddset(&set, signo);
+	if (sigprocmask(SIG_BLOCK, &set, NULL) < 0) {
+		perror("sigprocmask");
+		return -1;
+	}
+	sigaddset(&eb->sigmask, signo);
+	fd = signalfd(eb->sigfd, &eb->sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0) {
+		perror("signalfd");
+		sigdelset(&eb->sigmask, signo);
+		sigprocmask(SIG_UNBLOCK, &set, NULL);
+		return -1;
+	}
+	if (eb->sigfd == -1) {
+		eb->sigev = rtl_event_create(fd, signal_in, NULL, NULL, eb);
+		if (!eb->sigev || rtl_event_add(eb, eb->sigev) < 0) {
+			if (eb->sigev)
+				rtl_event_destroy(eb->sigev);
+			else
+				close(fd);
+			eb->sigev = NULL;
+			sigdelset(&eb->sigmask, signo);
+			sigprocmask(SIG_UNBLOCK, &set, NULL);
+			return -1;
+		}
+		eb->sigfd = fd;
+	}
+	eb->sighandlers[signo].cb = cb;
+	eb->sighandlers[signo].args = args;
+	return 0;
+}
+
+int rtl_event_signal_del(struct rtl_event_base *eb, int signo)
+{
+	sigset_t set;
+
+	if (!eb || signo <= 0 || signo >= _NSIG || !eb->sighandlers ||
+		!sigismember(&eb->sigmask, signo)) {
+		return -1;
+	}
+	sigdelset(&eb->sigmask, signo);
+	if (signalfd(eb->sigfd, &eb->sigmask, SFD_NONBLOCK | SFD_CLOEXEC) < 0)
+		perror("signalfd");
+	sigemptyset(&set);
+	sigaddset(&set, signo);
+	sigprocmask(SIG_UNBLOCK, &set, NULL);
+	eb->sighandlers[signo].cb = NULL;
+	eb->sighandlers[signo].args = NULL;
+	return 0;
+}
@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "rtl_event_group.h"
+#include "rtl_socket.h"
+#include "rtl_thread.h"
+
+struct event_worker {
+	struct rtl_event_group *g;
+	int cpu;
+	int lfd;
+	struct rtl_event_base *eb;
+	struct rtl_event *lev;
+	rtl_thread_t *thread;
+};
+
+struct rtl_event_group {
+	int nworkers;
+	rtl_event_group_accept_cb cb;
+	void *args;
+	struct event_worker *workers;
+};
+
+static void worker_accept(struct rtl_event *e, void *args)
+{
+	struct event_worker *w = (struct event_worker *)args;
+	struct sockaddr_in si;
+	socklen_t len;
+	int fd;
+
+	/* the listener is edge-triggered, accept until the backlog is empty */
+	for (;;) {
+		len = sizeof(si);
+		fd = accept4(e->evfd, (struct sockaddr *)&si, &len,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				fprintf(stderr, "accept4: %s\n", strerror(errno));
+			return;
+		}
+		w->g->cb(w->eb, fd, si.sin_addr.s_addr, ntohs(si.sin_port),
+				w->g->args);
+	}
+}
+
+static void *worker_loop(rtl_thread_t *t)
+{
+	struct event_worker *w = (struct event_worker *)t->args;
+
+	rtl_event_base_loop(w->eb);
+	return NULL;
+}
+
+static void worker_deinit(struct event_worker *w)
+{
+	if (w->thread) {
+		rtl_event_base_loop_break(w->eb);
+		rtl_thread_destroy(w->thread);
+	}
+	if (w->lev) {
+		rtl_event_del(w->eb, w->lev);
+		/* closes the listener as well */
+		rtl_event_destroy(w->lev);
+	} else if (w->lfd != -1) {
+		close(w->lfd);
+	}
+	rtl_event_base_destroy(w->eb);
+}
+
+struct rtl_event_group *rtl_event_group_create(int nworkers, const char *host,
+		uint16_t port, rtl_event_group_accept_cb cb, void *args)
+{
+	struct rtl_event_group *g;
+	struct event_worker *w;
+	rtl_thread_attr_t attr;
+	char name[32];
+	int ncpu, i;
+
+	if (!cb)
+		return NULL;
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1)
+		ncpu = 1;
+	if (nworkers <= 0)
+		nworkers = ncpu;
+
+	g = calloc(1, sizeof(struct rtl_event_group));
+	if (!g) {
+		fprintf(stderr, "calloc rtl_event_group failed!\n");
+		return NULL;
+	}
+	g->workers = calloc(nworkers, sizeof(struct event_worker));
+	if (!g->workers) {
+		fprintf(stderr, "calloc event_worker failed!\n");
+		free(g);
+		return NULL;
+	}
+	g->cb = cb;
+	g->args = args;
+
+	/* set up every loop and listener before any worker starts */
+	for (i = 0; i < nworkers; i++) {
+		w = &g->workers[i];
+		w->g = g;
+		w->cpu = i % ncpu;
+		w->lfd = -1;
+		g->nworkers++;
+
+		if (!(w->eb = rtl_event_base_create()))
+			goto err;
+		/* rtl_socket_tcp_bind_listen sets SO_REUSEPORT on every listener */
+		w->lfd = rtl_socket_tcp_bind_listen(host, port);
+		if (w->lfd == -1)
+			goto err;
+		if (rtl_socket_set_nonblock(w->lfd) == -1)
+			goto err;
+		w->lev = rtl_event_create(w->lfd, worker_accept, NULL, NULL, w);
+		if (!w->lev)
+			goto err;
+		if (rtl_event_add(w->eb, w->lev) < 0) {
+			rtl_event_destroy(w->lev);
+			w->lev = NULL;
+			w->lfd = -1;
+			goto err;
+		}
+	}
+	for (i = 0; i < nworkers; i++) {
+		w = &g->workers[i];
+		snprintf(name, sizeof(name), "event-worker-%d", i);
+		rtl_thread_attr_init(&attr);
+		rtl_thread_attr_set_cpu(&attr, w->cpu);
+		attr.lazy_sync = 1;
+		if (!(w->thread = rtl_thread_create_attr(worker_loop, name, w, &attr)))
+			goto err;
+	}
+	return g;
+
+err:
+	rtl_event_group_destroy(g);
+	return NULL;
+}
+
+void rtl_event_group_destroy(struct rtl_event_group *g)
+{
+	int i;
+
+	if (!g)
+		return;
+	for (i = 0; i < g->nworkers; i++)
+		worker_deinit(&g->workers[i]);
+	free(g->workers);
+	free(g);
+}
+
+int rtl_event_group_size(const struct rtl_event_group *g)
+{
+	return g->nworkers;
+}
+
+struct rtl_event_base *rtl_event_group_base(struct rtl_event_group *g, int i)
+{
+	if (!g || i < 0 || i >= g->nworkers)
+		return NULL;
+	return g->workers[i].eb;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "rtl_futex.h"
+
+#if ( __i386__ || __i386 || __amd64__ || __amd64 )
+#define cpu_pause() __asm__ ("pause")
+#else
+#define cpu_pause()
+#endif
+
+#define FUTEX_SPIN	128
+
+/* spinning only pays off when the owner can run meanwhile */
+static int futex_spin_limit(void)
+{
+	static int limit = -1;
+
+	if (limit < 0)
+		limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? FUTEX_SPIN : 0;
+	return limit;
+}
+
+/* relative timeout left until deadline, NULL to wait forever */
+static struct timespec *futex_timeout(int64_t deadline, struct timespec *ts)
+{
+	int64_t left;
+
+	if (!deadline)
+		return NULL;
+	left = deadline - rtl_futex_now();
+	if (left < 0)
+		left = 0;
+	ts->tv_sec = left / 1000000000;
+	ts->tv_nsec = left % 1000000000;
+	return ts;
+}
+
+void rtl_futex_mutex_init(rtl_futex_mutex_t *m)
+{
+	m->state = 0;
+}
+
+int rtl_futex_mutex_trylock(rtl_futex_mutex_t *m)
+{
+	int c = 0;
+
+	if (__atomic_compare_exchange_n(&m->state, &c, 1, 0,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 0;
+	return EBUSY;
+}
+
+/* U. Drepper, "Futexes Are Tricky", mutex 3 with a spinning phase */
+int rtl_futex_mutex_lock(rtl_futex_mutex_t *m)
+{
+	int spin = futex_spin_limit();
+	int c = 0;
+
+	if (__atomic_compare_exchange_n(&m->state, &c, 1, 0,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 0;
+	while (spin-- > 0 && c != 2) {
+		cpu_pause();
+		c = 0;
+		if (__atomic_compare_exchange_n(&m->state, &c, 1, 0,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return 0;
+	}
+	if (c != 2)
+		c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+	while (c != 0) {
+		rtl_futex_wait(&m->state, 2, NULL);
+		c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+	}
+	return 0;
+}
+
+int rtl_futex_mutex_unlock(rtl_futex_mutex_t *m)
+{
+	if (__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2)
+		rtl_futex_wake(&m->state, 1);
+	return 0;
+}
+
+void rtl_futex_cond_init(rtl_futex_cond_t *c)
+{
+	c->seq = 0;
+}
+
+int rtl_futex_cond_wait(rtl_futex_cond_t *c, rtl_futex_mutex_t *m, int64_t ms)
+{
+	int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+	struct timespec ts, *tsp = NULL;
+	int ret = 0;
+
+	if (ms >= 0) {
+		ts.tv_sec = ms / 1000;
+		ts.tv_nsec = (ms % 1000) * 1000000;
+		tsp = &ts;
+	}
+	rtl_futex_mutex_unlock(m);
+	if (rtl_futex_wait(&c->seq, seq, tsp) < 0 && errno == ETIMEDOUT)
+		ret = ETIMEDOUT;
+	/* other waiters may be woken with us, take the contended path */
+	while (__atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE) != 0)
+		rtl_futex_wait(&m->state, 2, NULL);
+	return ret;
+}
+
+void rtl_futex_cond_signal(rtl_futex_cond_t *c)
+{
+	__atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+	rtl_futex_wake(&c->seq, 1);
+}
+
+void rtl_futex_cond_signal_all(rtl_futex_cond_t *c)
+{
+	__atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+	rtl_futex_wake(&c->seq, INT_MAX);
+}
+
+void rtl_futex_sem_init(rtl_futex_sem_t *s, int value)
+{
+	s->value = value;
+	s->waiters = 0;
+}
+
+int rtl_futex_sem_trywait(rtl_futex_sem_t *s)
+{
+	int v = __atomic_load_n(&s->value, __ATOMIC_RELAXED);
+
+	while (v > 0) {
+		if (__atomic_compare_exchange_n(&s->value, &v, v - 1, 1,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return 0;
+	}
+	return -1;
+}
+
+int rtl_futex_sem_wait(rtl_futex_sem_t *s, int64_t ms)
+{
+	int64_t deadline = ms < 0 ? 0 : rtl_futex_now() + ms * 1000000;
+	int spin = futex_spin_limit();
+	struct timespec ts;
+
+	while (spin-- > 0) {
+		if (rtl_futex_sem_trywait(s) == 0)
+			return 0;
+		cpu_pause();
+	}
+	__atomic_add_fetch(&s->waiters, 1, __ATOMIC_SEQ_CST);
+	for (;;) {
+		if (rtl_futex_sem_trywait(s) == 0)
+			break;
+		if (deadline && rtl_futex_now() >= deadline) {
+			__atomic_sub_fetch(&s->waiters, 1, __ATOMIC_RELAXED);
+			return -1;
+		}
+		rtl_futex_wait(&s->value, 0, futex_timeout(deadline, &ts));
+	}
+	__atomic_sub_fetch(&s->waiters, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int rtl_futex_sem_signal(rtl_futex_sem_t *s)
+{
+	__atomic_add_fetch(&s->value, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST))
+		rtl_futex_wake(&s->value, 1);
+	return 0;
+}
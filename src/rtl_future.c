@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "rtl_future.h"
+#include "rtl_futex.h"
+
+struct future_link {
+	struct future_link *next;
+	rtl_future_t *f;
+};
+
+struct future_then {
+	struct future_then *next;
+	rtl_future_t *f;
+	struct rtl_event_base *eb;
+	rtl_future_cb cb;
+	void *args;
+};
+
+struct rtl_future {
+	int refs;
+	int done;				/* futex word, set once the result is in */
+	int npending;			/* dependencies still running, plus one */
+	rtl_futex_mutex_t lock;	/* guards the lists against completion */
+	struct future_link *dependents;
+	struct future_then *thens;
+	rtl_pool_t *pool;
+	rtl_future_fn fn;
+	void *args;
+	void *result;
+};
+
+static void future_run(void *args);
+
+static void future_get_ref(rtl_future_t *f)
+{
+	__atomic_add_fetch(&f->refs, 1, __ATOMIC_RELAXED);
+}
+
+void rtl_future_release(rtl_future_t *f)
+{
+	if (f && __atomic_sub_fetch(&f->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(f);
+}
+
+/* drop one pending input of f, scheduling it with the last one */
+static void future_input_done(rtl_future_t *f)
+{
+	if (__atomic_sub_fetch(&f->npending, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	if (rtl_pool_submit(f->pool, future_run, f) < 0) {
+		fprintf(stderr, "rtl_future: pool submit failed, running inline\n");
+		future_run(f);
+	}
+}
+
+static void future_then_run(void *args)
+{
+	struct future_then *t = (struct future_then *)args;
+
+	t->cb(t->f, t->args);
+	rtl_future_release(t->f);
+	free(t);
+}
+
+static void future_then_dispatch(struct future_then *t)
+{
+	if (t->eb && rtl_event_base_post(t->eb, future_then_run, t) == 0)
+		return;
+	future_then_run(t);
+}
+
+static void future_run(void *args)
+{
+	rtl_future_t *f = (rtl_future_t *)args;
+	struct future_link *dep, *next_dep;
+	struct future_then *t, *next_t;
+
+	f->result = f->fn(f->args);
+
+	rtl_futex_mutex_lock(&f->lock);
+	__atomic_store_n(&f->done, 1, __ATOMIC_RELEASE);
+	dep = f->dependents;
+	t = f->thens;
+	f->dependents = NULL;
+	f->thens = NULL;
+	rtl_futex_mutex_unlock(&f->lock);
+	rtl_futex_wake(&f->done, INT_MAX);
+
+	for (; dep; dep = next_dep) {
+		next_dep = dep->next;
+		future_input_done(dep->f);
+		free(dep);
+	}
+	for (; t; t = next_t) {
+		next_t = t->next;
+		future_then_dispatch(t);
+	}
+	/* the reference held while scheduled */
+	rtl_future_release(f);
+}
+
+rtl_future_t *rtl_future_submit_after(rtl_pool_t *pool, rtl_future_fn fn,
+		void *args, rtl_future_t **deps, int ndeps)
+{
+	struct future_link *link;
+	rtl_future_t *f;
+	int i;
+
+	if (!pool || !fn || ndeps < 0 || (ndeps && !deps)) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return NULL;
+	}
+	f = calloc(1, sizeof(rtl_future_t));
+	if (!f) {
+		fprintf(stderr, "calloc rtl_future_t failed!\n");
+		return NULL;
+	}
+	/* one reference for the caller and one until the task has run */
+	f->refs = 2;
+	f->npending = ndeps + 1;
+	f->pool = pool;
+	f->fn = fn;
+	f->args = args;
+
+	for (i = 0; i < ndeps; i++) {
+		rtl_future_t *d = deps[i];
+
+		link = malloc(sizeof(struct future_link));
+		rtl_futex_mutex_lock(&d->lock);
+		if (!d->done && link) {
+			link->f = f;
+			link->next = d->dependents;
+			d->dependents = link;
+			link = NULL;
+			rtl_futex_mutex_unlock(&d->lock);
+			continue;
+		}
+		rtl_futex_mutex_unlock(&d->lock);
+		if (link) {
+			free(link);
+		} else {
+			/* no memory to chain, wait for the input here instead */
+			fprintf(stderr, "malloc future_link failed, waiting inline\n");
+			rtl_future_wait(d, -1);
+		}
+		__atomic_sub_fetch(&f->npending, 1, __ATOMIC_ACQ_REL);
+	}
+	/* drop the guard, the task goes to the pool once all inputs are done */
+	future_input_done(f);
+	return f;
+}
+
+rtl_future_t *rtl_future_submit(rtl_pool_t *pool, rtl_future_fn fn, void *args)
+{
+	return rtl_future_submit_after(pool, fn, args, NULL, 0);
+}
+
+int rtl_future_ready(rtl_future_t *f)
+{
+	return __atomic_load_n(&f->done, __ATOMIC_ACQUIRE);
+}
+
+int rtl_future_wait(rtl_future_t *f, int64_t ms)
+{
+	int64_t deadline = ms < 0 ? 0 : rtl_futex_now() + ms * 1000000;
+	struct timespec ts, *tsp = NULL;
+	int64_t left;
+
+	while (!__atomic_load_n(&f->done, __ATOMIC_ACQUIRE)) {
+		if (deadline) {
+			left = deadline - rtl_futex_now();
+			if (left <= 0)
+				return -1;
+			ts.tv_sec = left / 1000000000;
+			ts.tv_nsec = left % 1000000000;
+			tsp = &ts;
+		}
+		rtl_futex_wait(&f->done, 0, tsp);
+	}
+	return 0;
+}
+
+void *rtl_future_get(rtl_future_t *f)
+{
+	rtl_future_wait(f, -1);
+	return f->result;
+}
+
+int rtl_future_then(rtl_future_t *f, struct rtl_event_base *eb,
+		rtl_future_cb cb, void *args)
+{
+	struct future_then *t;
+
+	if (!f || !cb)
+		return -1;
+	t = malloc(sizeof(struct future_then));
+	if (!t) {
+		fprintf(stderr, "malloc future_then failed!\n");
+		return -1;
+	}
+	future_get_ref(f);
+	t->f = f;
+	t->eb = eb;
+	t->cb = cb;
+	t->args = args;
+
+	rtl_futex_mutex_lock(&f->lock);
+	if (!f->done) {
+		t->next = f->thens;
+		f->thens = t;
+		rtl_futex_mutex_unlock(&f->lock);
+		return 0;
+	}
+	rtl_futex_mutex_unlock(&f->lock);
+	future_then_dispatch(t);
+	return 0;
+}
@@ -3,11 +3,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <sched.h>
 #include <pthread.h>
 #include <semaphore.h>
 
 #include "rtl_lock.h"
+#include "rtl_futex.h"
 
 /* spin lock APIs */
 #if ( __i386__ || __i386 || __amd64__ || __amd64 )
@@ -21,16 +23,26 @@
 
 rtl_spin_lock_t *rtl_spin_lock_init(void)
 {
+	return rtl_spin_lock_init_type(RTL_SPIN_TAS);
+}
+
+rtl_spin_lock_t *rtl_spin_lock_init_type(int type)
+{
+	if (type < RTL_SPIN_TAS || type > RTL_SPIN_MCS) {
+		fprintf(stderr, "unknown spin lock type:%d\n", type);
+		return NULL;
+	}
 	rtl_spin_lock_t *lock = (rtl_spin_lock_t *)calloc(1, sizeof(rtl_spin_lock_t));
 	if (!lock) {
 		fprintf(stderr, "malloc rtl_spin_lock_t failed:%d\n", errno);
 		return NULL;
 	}
 	lock->ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	lock->type = type;
 	return lock;
 }
 
-int rtl_spin_lock(rtl_spin_lock_t *lock)
+static int tas_lock(rtl_spin_lock_t *lock)
 {
 	int spin = 2048;
 	int value = 1;
@@ -54,15 +66,164 @@ int rtl_spin_lock(rtl_spin_lock_t *lock)
 	return 0;
 }
 
-int rtl_spin_unlock(rtl_spin_lock_t *lock)
+/*
+ * waiters of the fair locks must not burn the cpu the next owner was
+ * preempted on, so they give it up after a while of pausing
+ */
+static void spin_wait(rtl_spin_lock_t *lock, unsigned int *round, unsigned int n)
+{
+	unsigned int i;
+	if (lock->ncpu > 1 && ++*round < 1024) {
+		for (i = 0; i < n; i++) {
+			cpu_pause();
+		}
+	} else {
+		*round = 0;
+		sched_yield();
+	}
+}
+
+static int ticket_lock(rtl_spin_lock_t *lock)
+{
+	unsigned int me = __atomic_fetch_add(&lock->ticket, 1, __ATOMIC_RELAXED);
+	unsigned int owner, round = 0;
+	while ((owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE)) != me) {
+		/* back off in proportion to the queue ahead of us */
+		spin_wait(lock, &round, (me - owner) * 32);
+	}
+	return 0;
+}
+
+static int ticket_trylock(rtl_spin_lock_t *lock)
+{
+	unsigned int owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+	return atomic_cmp_set(&lock->ticket, owner, owner + 1);
+}
+
+static int ticket_unlock(rtl_spin_lock_t *lock)
+{
+	__atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* queue nodes of the mcs locks held or waited for by this thread */
+static __thread struct rtl_mcs_node mcs_nodes[RTL_MCS_NESTING];
+static __thread uint32_t mcs_used;
+
+static struct rtl_mcs_node *mcs_node_get(void)
+{
+	int i;
+	if (mcs_used == UINT32_MAX) {
+		fprintf(stderr, "too many mcs locks held by one thread\n");
+		return NULL;
+	}
+	i = __builtin_ctz(~mcs_used);
+	mcs_used |= 1U << i;
+	mcs_nodes[i].next = NULL;
+	mcs_nodes[i].wait = 1;
+	return &mcs_nodes[i];
+}
+
+static void mcs_node_put(struct rtl_mcs_node *node)
+{
+	mcs_used &= ~(1U << (node - mcs_nodes));
+}
+
+static int mcs_lock(rtl_spin_lock_t *lock)
+{
+	struct rtl_mcs_node *node = mcs_node_get();
+	struct rtl_mcs_node *prev;
+	unsigned int round = 0;
+	if (!node) {
+		return -1;
+	}
+	prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+	if (prev) {
+		__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+		while (__atomic_load_n(&node->wait, __ATOMIC_ACQUIRE)) {
+			spin_wait(lock, &round, 32);
+		}
+	}
+	lock->holder = node;
+	return 0;
+}
+
+static int mcs_trylock(rtl_spin_lock_t *lock)
+{
+	struct rtl_mcs_node *node, *expect = NULL;
+	if (__atomic_load_n(&lock->tail, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+	node = mcs_node_get();
+	if (!node) {
+		return 0;
+	}
+	if (!__atomic_compare_exchange_n(&lock->tail, &expect, node, 0,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		mcs_node_put(node);
+		return 0;
+	}
+	lock->holder = node;
+	return 1;
+}
+
+static int mcs_unlock(rtl_spin_lock_t *lock)
 {
-	lock->lock = 0;
+	struct rtl_mcs_node *node = lock->holder;
+	struct rtl_mcs_node *next, *expect = node;
+	unsigned int round = 0;
+	next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+	if (!next) {
+		if (__atomic_compare_exchange_n(&lock->tail, &expect, NULL, 0,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			mcs_node_put(node);
+			return 0;
+		}
+		/* a successor swapped the tail but has not linked itself yet */
+		while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) {
+			spin_wait(lock, &round, 1);
+		}
+	}
+	__atomic_store_n(&next->wait, 0, __ATOMIC_RELEASE);
+	mcs_node_put(node);
 	return 0;
 }
 
+int rtl_spin_lock(rtl_spin_lock_t *lock)
+{
+	switch (lock->type) {
+		case RTL_SPIN_TICKET:
+			return ticket_lock(lock);
+		case RTL_SPIN_MCS:
+			return mcs_lock(lock);
+		default:
+			return tas_lock(lock);
+	}
+}
+
+int rtl_spin_unlock(rtl_spin_lock_t *lock)
+{
+	switch (lock->type) {
+		case RTL_SPIN_TICKET:
+			return ticket_unlock(lock);
+		case RTL_SPIN_MCS:
+			return mcs_unlock(lock);
+		default:
+			lock->lock = 0;
+			return 0;
+	}
+}
+
 int rtl_spin_trylock(rtl_spin_lock_t *lock)
 {
-	return (lock->lock == 0 && atomic_cmp_set(&lock->lock, 0, 1));
+	switch (lock->type) {
+		case RTL_SPIN_TICKET:
+			return ticket_trylock(lock);
+		case RTL_SPIN_MCS:
+			return mcs_trylock(lock);
+		default:
+			return (lock->lock == 0 && atomic_cmp_set(&lock->lock, 0, 1));
+	}
 }
 
 void rtl_spin_lock_deinit(rtl_spin_lock_t *lock)
@@ -73,16 +234,338 @@ void rtl_spin_lock_deinit(rtl_spin_lock_t *lock)
 	free(lock);
 }
 
+/* big-reader lock APIs */
+#define BRLOCK_CACHELINE	64
+#define BRLOCK_MAX_SLOTS	1024
+
+struct brlock_slot {
+	int readers;
+} __attribute__ ((aligned(BRLOCK_CACHELINE)));
+
+struct rtl_brlock {
+	int writer;
+	int nslots;
+	rtl_futex_mutex_t wmutex;
+	struct brlock_slot slots[];
+};
+
+/* reader slot of this thread, handed out round robin */
+static __thread int brlock_tid = -1;
+static int brlock_next_tid;
+
+static struct brlock_slot *brlock_slot(rtl_brlock_t *lock)
+{
+	if (brlock_tid < 0) {
+		brlock_tid = __atomic_fetch_add(&brlock_next_tid, 1, __ATOMIC_RELAXED) &
+			(BRLOCK_MAX_SLOTS - 1);
+	}
+	return &lock->slots[brlock_tid & (lock->nslots - 1)];
+}
+
+rtl_brlock_t *rtl_brlock_init(void)
+{
+	rtl_brlock_t *lock;
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int nslots = 1;
+	while (nslots < ncpu && nslots < BRLOCK_MAX_SLOTS) {
+		nslots <<= 1;
+	}
+	size_t size = sizeof(rtl_brlock_t) + nslots * sizeof(struct brlock_slot);
+	if (posix_memalign((void **)&lock, BRLOCK_CACHELINE, size) != 0) {
+		fprintf(stderr, "malloc rtl_brlock_t failed\n");
+		return NULL;
+	}
+	memset(lock, 0, size);
+	lock->nslots = nslots;
+	return lock;
+}
+
+int rtl_brlock_rdlock(rtl_brlock_t *lock)
+{
+	if (!lock) {
+		return -1;
+	}
+	struct brlock_slot *slot = brlock_slot(lock);
+	for ( ;; ) {
+		__atomic_add_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST);
+		if (!__atomic_load_n(&lock->writer, __ATOMIC_SEQ_CST)) {
+			return 0;
+		}
+		/* back out and let the writer finish */
+		__atomic_sub_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST);
+		rtl_futex_wake(&slot->readers, 1);
+		while (__atomic_load_n(&lock->writer, __ATOMIC_ACQUIRE)) {
+			rtl_futex_wait(&lock->writer, 1, NULL);
+		}
+	}
+}
+
+int rtl_brlock_rdunlock(rtl_brlock_t *lock)
+{
+	if (!lock) {
+		return -1;
+	}
+	struct brlock_slot *slot = brlock_slot(lock);
+	__atomic_sub_fetch(&slot->readers, 1, __ATOMIC_SEQ_CST);
+	/* a writer may be sleeping on the slot */
+	if (__atomic_load_n(&lock->writer, __ATOMIC_SEQ_CST)) {
+		rtl_futex_wake(&slot->readers, 1);
+	}
+	return 0;
+}
+
+int rtl_brlock_wrlock(rtl_brlock_t *lock)
+{
+	if (!lock) {
+		return -1;
+	}
+	int i;
+	rtl_futex_mutex_lock(&lock->wmutex);
+	__atomic_store_n(&lock->writer, 1, __ATOMIC_SEQ_CST);
+	for (i = 0; i < lock->nslots; i++) {
+		int spin = 0;
+		int readers;
+		while ((readers = __atomic_load_n(&lock->slots[i].readers, __ATOMIC_SEQ_CST))) {
+			if (++spin < 64) {
+				cpu_pause();
+			} else {
+				rtl_futex_wait(&lock->slots[i].readers, readers, NULL);
+			}
+		}
+	}
+	return 0;
+}
+
+int rtl_brlock_wrunlock(rtl_brlock_t *lock)
+{
+	if (!lock) {
+		return -1;
+	}
+	__atomic_store_n(&lock->writer, 0, __ATOMIC_SEQ_CST);
+	/* writes are rare, wake the parked readers unconditionally */
+	rtl_futex_wake(&lock->writer, INT_MAX);
+	rtl_futex_mutex_unlock(&lock->wmutex);
+	return 0;
+}
+
+void rtl_brlock_deinit(rtl_brlock_t *lock)
+{
+	if (!lock) {
+		return;
+	}
+	free(lock);
+}
+
+/* lock contention profiling */
+#ifdef RTL_LOCK_PROFILE
+struct lock_prof {
+	struct lock_prof *prev;
+	struct lock_prof *next;
+	char name[48];
+	void *site;
+	uint64_t acquired;
+	uint64_t contended;
+	uint64_t wait_ns;
+	uint64_t max_wait_ns;
+};
+
+/* the pthread object comes first, so the plain casts keep working */
+struct prof_mutex {
+	pthread_mutex_t mutex;
+	struct lock_prof prof;
+};
+
+struct prof_rwlock {
+	pthread_rwlock_t rwlock;
+	struct lock_prof prof;
+};
+
+#define MUTEX_SIZE			sizeof(struct prof_mutex)
+#define RWLOCK_SIZE			sizeof(struct prof_rwlock)
+#define mutex_prof(lock)	(&((struct prof_mutex *)(lock))->prof)
+#define rwlock_prof(lock)	(&((struct prof_rwlock *)(lock))->prof)
+
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lock_prof *prof_list;
+
+static uint64_t prof_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void prof_register(struct lock_prof *p, void *site)
+{
+	p->site = site;
+	pthread_mutex_lock(&prof_lock);
+	p->prev = NULL;
+	p->next = prof_list;
+	if (prof_list) {
+		prof_list->prev = p;
+	}
+	prof_list = p;
+	pthread_mutex_unlock(&prof_lock);
+}
+
+static void prof_unregister(struct lock_prof *p)
+{
+	pthread_mutex_lock(&prof_lock);
+	if (p->prev) {
+		p->prev->next = p->next;
+	} else {
+		prof_list = p->next;
+	}
+	if (p->next) {
+		p->next->prev = p->prev;
+	}
+	pthread_mutex_unlock(&prof_lock);
+}
+
+/* account one acquisition, start is 0 when it did not have to wait */
+static void prof_account(struct lock_prof *p, uint64_t start)
+{
+	uint64_t wait, max;
+	__atomic_add_fetch(&p->acquired, 1, __ATOMIC_RELAXED);
+	if (!start) {
+		return;
+	}
+	wait = prof_now() - start;
+	__atomic_add_fetch(&p->contended, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&p->wait_ns, wait, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&p->max_wait_ns, __ATOMIC_RELAXED);
+	while (wait > max && !__atomic_compare_exchange_n(&p->max_wait_ns, &max,
+				wait, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static int prof_same_key(const struct lock_prof *a, const struct lock_prof *b)
+{
+	if (a->name[0] || b->name[0]) {
+		return strcmp(a->name, b->name) == 0;
+	}
+	return a->site == b->site;
+}
+
+static int prof_cmp(const void *a, const void *b)
+{
+	const struct lock_prof *x = (const struct lock_prof *)a;
+	const struct lock_prof *y = (const struct lock_prof *)b;
+	if (x->contended != y->contended) {
+		return x->contended < y->contended ? 1 : -1;
+	}
+	if (x->wait_ns != y->wait_ns) {
+		return x->wait_ns < y->wait_ns ? 1 : -1;
+	}
+	return 0;
+}
+
+void rtl_mutex_lock_set_name(rtl_mutex_lock_t *lock, const char *name)
+{
+	if (lock && name) {
+		snprintf(mutex_prof(lock)->name, sizeof(mutex_prof(lock)->name), "%s", name);
+	}
+}
+
+void rtl_rwlock_set_name(rtl_rwlock_t *lock, const char *name)
+{
+	if (lock && name) {
+		snprintf(rwlock_prof(lock)->name, sizeof(rwlock_prof(lock)->name), "%s", name);
+	}
+}
+
+void rtl_lock_profile_dump(FILE *fp, int topn)
+{
+	struct lock_prof *p, *keys = NULL;
+	int nkeys = 0, cap = 0;
+	int i;
+
+	/* sum up the live locks by key */
+	pthread_mutex_lock(&prof_lock);
+	for (p = prof_list; p; p = p->next) {
+		for (i = 0; i < nkeys; i++) {
+			if (prof_same_key(&keys[i], p)) {
+				break;
+			}
+		}
+		if (i == nkeys) {
+			if (nkeys == cap) {
+				struct lock_prof *n;
+				cap = cap ? cap * 2 : 64;
+				n = realloc(keys, cap * sizeof(struct lock_prof));
+				if (!n) {
+					fprintf(stderr, "realloc lock profile failed!\n");
+					break;
+				}
+				keys = n;
+			}
+			memset(&keys[nkeys], 0, sizeof(struct lock_prof));
+			memcpy(keys[nkeys].name, p->name, sizeof(p->name));
+			keys[nkeys].site = p->site;
+			nkeys++;
+		}
+		keys[i].acquired += __atomic_load_n(&p->acquired, __ATOMIC_RELAXED);
+		keys[i].contended += __atomic_load_n(&p->contended, __ATOMIC_RELAXED);
+		keys[i].wait_ns += __atomic_load_n(&p->wait_ns, __ATOMIC_RELAXED);
+		if (p->max_wait_ns > keys[i].max_wait_ns) {
+			keys[i].max_wait_ns = p->max_wait_ns;
+		}
+	}
+	pthread_mutex_unlock(&prof_lock);
+
+	qsort(keys, nkeys, sizeof(struct lock_prof), prof_cmp);
+	if (topn <= 0 || topn > nkeys) {
+		topn = nkeys;
+	}
+	fprintf(fp, "%-32s %12s %12s %7s %14s %12s\n", "lock", "acquired",
+			"contended", "cont%", "wait_us", "max_wait_us");
+	for (i = 0; i < topn; i++) {
+		char key[48];
+		p = &keys[i];
+		if (p->name[0]) {
+			snprintf(key, sizeof(key), "%s", p->name);
+		} else {
+			snprintf(key, sizeof(key), "%p", p->site);
+		}
+		fprintf(fp, "%-32s %12llu %12llu %6.2f%% %14llu %12llu\n", key,
+				(unsigned long long)p->acquired,
+				(unsigned long long)p->contended,
+				p->acquired ? 100.0 * p->contended / p->acquired : 0.0,
+				(unsigned long long)(p->wait_ns / 1000),
+				(unsigned long long)(p->max_wait_ns / 1000));
+	}
+	free(keys);
+}
+
+void rtl_lock_profile_reset(void)
+{
+	struct lock_prof *p;
+	pthread_mutex_lock(&prof_lock);
+	for (p = prof_list; p; p = p->next) {
+		__atomic_store_n(&p->acquired, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&p->contended, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&p->wait_ns, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&p->max_wait_ns, 0, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&prof_lock);
+}
+#else
+#define MUTEX_SIZE			sizeof(pthread_mutex_t)
+#define RWLOCK_SIZE			sizeof(pthread_rwlock_t)
+#endif
+
 /* mutex lock APIs */
 rtl_mutex_lock_t *rtl_mutex_lock_init(void)
 {
-	pthread_mutex_t *lock = (pthread_mutex_t *)calloc(1,
-			sizeof(pthread_mutex_t));
+	pthread_mutex_t *lock = (pthread_mutex_t *)calloc(1, MUTEX_SIZE);
 	if (!lock) {
 		fprintf(stderr, "malloc pthread_mutex_t failed:%d\n", errno);
 		return NULL;
 	}
 	pthread_mutex_init(lock, NULL);
+#ifdef RTL_LOCK_PROFILE
+	prof_register(mutex_prof(lock), __builtin_return_address(0));
+#endif
 	return lock;
 }
 
@@ -92,6 +575,9 @@ void rtl_mutex_lock_deinit(rtl_mutex_lock_t *ptr)
 		return;
 	}
 	pthread_mutex_t *lock = (pthread_mutex_t *)ptr;
+#ifdef RTL_LOCK_PROFILE
+	prof_unregister(mutex_prof(lock));
+#endif
 	int ret = pthread_mutex_destroy(lock);
 	if (ret != 0) {
 		switch (ret) {
@@ -113,11 +599,15 @@ int rtl_mutex_trylock(rtl_mutex_lock_t *ptr)
 	}
 	pthread_mutex_t *lock = (pthread_mutex_t *)ptr;
 	int ret = pthread_mutex_trylock(lock);
+#ifdef RTL_LOCK_PROFILE
+	if (ret == 0) {
+		prof_account(mutex_prof(lock), 0);
+	}
+#endif
 	if (ret != 0) {
 		switch (ret) {
 			case EBUSY:
-				fprintf(stderr, "the mutex could not be acquired"
-						" because it was currently locked.\n");
+				/* contention is not an error */
 				break;
 			case EINVAL:
 				fprintf(stderr, "the mutex has not been properly initialized.\n");
@@ -136,7 +626,19 @@ int rtl_mutex_lock(rtl_mutex_lock_t *ptr)
 		return -1;
 	}
 	pthread_mutex_t *lock = (pthread_mutex_t *)ptr;
+#ifdef RTL_LOCK_PROFILE
+	uint64_t start = 0;
+	int ret = pthread_mutex_trylock(lock);
+	if (ret == EBUSY) {
+		start = prof_now();
+		ret = pthread_mutex_lock(lock);
+	}
+	if (ret == 0) {
+		prof_account(mutex_prof(lock), start);
+	}
+#else
 	int ret = pthread_mutex_lock(lock);
+#endif
 	if (ret != 0) {
 		switch (ret) {
 			case EDEADLK:
@@ -281,8 +783,7 @@ void rtl_mutex_cond_signal_all(rtl_mutex_cond_t *ptr)
 /* read-write lock APIs */
 rtl_rwlock_t *rtl_rwlock_init(void)
 {
-	pthread_rwlock_t *lock = (pthread_rwlock_t *)calloc(1,
-			sizeof(pthread_rwlock_t));
+	pthread_rwlock_t *lock = (pthread_rwlock_t *)calloc(1, RWLOCK_SIZE);
 	if (!lock) {
 		fprintf(stderr, "malloc pthread_rwlock_t failed:%d\n", errno);
 		return NULL;
@@ -309,6 +810,11 @@ rtl_rwlock_t *rtl_rwlock_init(void)
 		free(lock);
 		lock = NULL;
 	}
+#ifdef RTL_LOCK_PROFILE
+	if (lock) {
+		prof_register(rwlock_prof(lock), __builtin_return_address(0));
+	}
+#endif
 
 	return lock;
 }
@@ -319,6 +825,9 @@ void rtl_rwlock_deinit(rtl_rwlock_t *ptr)
 		return;
 	}
 	pthread_rwlock_t *lock = (pthread_rwlock_t *)ptr;
+#ifdef RTL_LOCK_PROFILE
+	prof_unregister(rwlock_prof(lock));
+#endif
 	if (0 != pthread_rwlock_destroy(lock)) {
 		fprintf(stderr, "pthread_rwlock_destroy failed!\n");
 	}
@@ -331,7 +840,19 @@ int rtl_rwlock_rdlock(rtl_rwlock_t *ptr)
 		return -1;
 	}
 	pthread_rwlock_t *lock = (pthread_rwlock_t *)ptr;
+#ifdef RTL_LOCK_PROFILE
+	uint64_t start = 0;
+	int ret = pthread_rwlock_tryrdlock(lock);
+	if (ret == EBUSY) {
+		start = prof_now();
+		ret = pthread_rwlock_rdlock(lock);
+	}
+	if (ret == 0) {
+		prof_account(rwlock_prof(lock), start);
+	}
+#else
 	int ret = pthread_rwlock_rdlock(lock);
+#endif
 	if (ret != 0) {
 		switch (ret) {
 			case EBUSY:
@@ -362,6 +883,11 @@ int rtl_rwlock_tryrdlock(rtl_rwlock_t *ptr)
 	}
 	pthread_rwlock_t *lock = (pthread_rwlock_t *)ptr;
 	int ret = pthread_rwlock_tryrdlock(lock);
+#ifdef RTL_LOCK_PROFILE
+	if (ret == 0) {
+		prof_account(rwlock_prof(lock), 0);
+	}
+#endif
 	if (ret != 0) {
 		switch (ret) {
 			case EBUSY:
@@ -391,7 +917,19 @@ int rtl_rwlock_wrlock(rtl_rwlock_t *ptr)
 		return -1;
 	}
 	pthread_rwlock_t *lock = (pthread_rwlock_t *)ptr;
+#ifdef RTL_LOCK_PROFILE
+	uint64_t start = 0;
+	int ret = pthread_rwlock_trywrlock(lock);
+	if (ret == EBUSY) {
+		start = prof_now();
+		ret = pthread_rwlock_wrlock(lock);
+	}
+	if (ret == 0) {
+		prof_account(rwlock_prof(lock), start);
+	}
+#else
 	int ret = pthread_rwlock_wrlock(lock);
+#endif
 	if (ret != 0) {
 		switch (ret) {
 			case EDEADLK:
@@ -413,6 +951,11 @@ int rtl_rwlock_trywrlock(rtl_rwlock_t *ptr)
 	}
 	pthread_rwlock_t *lock = (pthread_rwlock_t *)ptr;
 	int ret = pthread_rwlock_trywrlock(lock);
+#ifdef RTL_LOCK_PROFILE
+	if (ret == 0) {
+		prof_account(rwlock_prof(lock), 0);
+	}
+#endif
 	if (ret != 0) {
 		switch (ret) {
 			case EBUSY:
@@ -509,9 +1052,6 @@ int rtl_sem_lock_wait(rtl_sem_lock_t *ptr, int64_t ms)
 					fprintf(stderr, "The value of abs_timeout.tv_nsecs is less than 0, "
 							"or greater than or equal to 1000 million.\n");
 					break;
-				case ETIMEDOUT:
-					fprintf(stderr, "The call timed out before the semaphore could be locked.\n");
-					break;
 			}
 		}
 	}
@@ -526,13 +1066,6 @@ int rtl_sem_lock_trywait(rtl_sem_lock_t *ptr)
 	int ret;
 	rtl_sem_lock_t *lock = (rtl_sem_lock_t *)ptr;
 	ret = sem_trywait(lock);
-	if (ret != 0) {
-		switch (errno) {
-			case EAGAIN:
-				fprintf(stderr, "The operation could not be performed without blocking\n");
-				break;
-		}
-	}
 	return ret;
 }
 
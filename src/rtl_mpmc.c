@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "rtl_mpmc.h"
+#include "rtl_futex.h"
+
+#define CACHELINE	64
+
+struct mpmc_cell {
+	size_t seq;
+	void *data;
+};
+
+/* one side of the queue, producers or consumers */
+struct mpmc_side {
+	size_t pos;
+	int wake_seq;		/* futex word, bumped when the other side made progress */
+	int waiters;
+} __attribute__ ((aligned(CACHELINE)));
+
+struct rtl_mpmc {
+	struct mpmc_cell *cells;
+	size_t mask;
+	struct mpmc_side enq;
+	struct mpmc_side deq;
+};
+
+rtl_mpmc_t *rtl_mpmc_create(size_t size)
+{
+	rtl_mpmc_t *q;
+	size_t n = 2;
+	size_t i;
+
+	while (n < size)
+		n <<= 1;
+	if (posix_memalign((void **)&q, CACHELINE, sizeof(rtl_mpmc_t))) {
+		fprintf(stderr, "posix_memalign rtl_mpmc_t failed!\n");
+		return NULL;
+	}
+	q->cells = calloc(n, sizeof(struct mpmc_cell));
+	if (!q->cells) {
+		fprintf(stderr, "calloc mpmc cells failed!\n");
+		free(q);
+		return NULL;
+	}
+	for (i = 0; i < n; i++)
+		q->cells[i].seq = i;
+	q->mask = n - 1;
+	q->enq.pos = q->deq.pos = 0;
+	q->enq.wake_seq = q->deq.wake_seq = 0;
+	q->enq.waiters = q->deq.waiters = 0;
+	return q;
+}
+
+void rtl_mpmc_destroy(rtl_mpmc_t *q)
+{
+	if (!q)
+		return;
+	free(q->cells);
+	free(q);
+}
+
+/* let a parked thread of side s know the queue changed */
+static void mpmc_notify(struct mpmc_side *s)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&s->waiters, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&s->wake_seq, 1, __ATOMIC_SEQ_CST);
+		rtl_futex_wake(&s->wake_seq, 1);
+	}
+}
+
+static int mpmc_push(rtl_mpmc_t *q, void *data)
+{
+	size_t pos = __atomic_load_n(&q->enq.pos, __ATOMIC_RELAXED);
+	struct mpmc_cell *cell;
+	intptr_t diff;
+	size_t seq;
+
+	for (;;) {
+		cell = &q->cells[pos & q->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->enq.pos, &pos, pos + 1, 1,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return -1;
+		} else {
+			pos = __atomic_load_n(&q->enq.pos, __ATOMIC_RELAXED);
+		}
+	}
+	cell->data = data;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int mpmc_pop(rtl_mpmc_t *q, void **data)
+{
+	size_t pos = __atomic_load_n(&q->deq.pos, __ATOMIC_RELAXED);
+	struct mpmc_cell *cell;
+	intptr_t diff;
+	size_t seq;
+
+	for (;;) {
+		cell = &q->cells[pos & q->mask];
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&q->deq.pos, &pos, pos + 1, 1,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return -1;
+		} else {
+			pos = __atomic_load_n(&q->deq.pos, __ATOMIC_RELAXED);
+		}
+	}
+	*data = cell->data;
+	__atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int rtl_mpmc_trypush(rtl_mpmc_t *q, void *data)
+{
+	if (mpmc_push(q, data) < 0)
+		return -1;
+	mpmc_notify(&q->deq);
+	return 0;
+}
+
+int rtl_mpmc_trypop(rtl_mpmc_t *q, void **data)
+{
+	if (mpmc_pop(q, data) < 0)
+		return -1;
+	mpmc_notify(&q->enq);
+	return 0;
+}
+
+/*
+ * park on side s until op succeeds. the wake sequence is read before the
+ * last attempt, so a notify between the attempt and the futex wait makes
+ * the wait return at once instead of being lost.
+ */
+static int mpmc_wait(rtl_mpmc_t *q, struct mpmc_side *s, int64_t ms,
+		int (*op)(rtl_mpmc_t *, void *), void *arg)
+{
+	int64_t deadline = ms < 0 ? 0 : rtl_futex_now() + ms * 1000000;
+	struct timespec ts, *tsp = NULL;
+	int64_t left;
+	int seq;
+
+	for (;;) {
+		if (op(q, arg) == 0)
+			return 0;
+		seq = __atomic_load_n(&s->wake_seq, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&s->waiters, 1, __ATOMIC_SEQ_CST);
+		if (op(q, arg) == 0) {
+			__atomic_sub_fetch(&s->waiters, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+		if (ms >= 0) {
+			left = deadline - rtl_futex_now();
+			if (left <= 0) {
+				__atomic_sub_fetch(&s->waiters, 1, __ATOMIC_RELAXED);
+				return -1;
+			}
+			ts.tv_sec = left / 1000000000;
+			ts.tv_nsec = left % 1000000000;
+			tsp = &ts;
+		}
+		rtl_futex_wait(&s->wake_seq, seq, tsp);
+		__atomic_sub_fetch(&s->waiters, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static int mpmc_push_op(rtl_mpmc_t *q, void *arg)
+{
+	return rtl_mpmc_trypush(q, arg);
+}
+
+static int mpmc_pop_op(rtl_mpmc_t *q, void *arg)
+{
+	return rtl_mpmc_trypop(q, (void **)arg);
+}
+
+int rtl_mpmc_push(rtl_mpmc_t *q, void *data, int64_t ms)
+{
+	return mpmc_wait(q, &q->enq, ms, mpmc_push_op, data);
+}
+
+int rtl_mpmc_pop(rtl_mpmc_t *q, void **data, int64_t ms)
+{
+	return mpmc_wait(q, &q->deq, ms, mpmc_pop_op, data);
+}
+
+size_t rtl_mpmc_count(rtl_mpmc_t *q)
+{
+	size_t enq = __atomic_load_n(&q->enq.pos, __ATOMIC_RELAXED);
+	size_t deq = __atomic_load_n(&q->deq.pos, __ATOMIC_RELAXED);
+
+	return enq > deq ? enq - deq : 0;
+}
@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "rtl_pool.h"
+#include "rtl_thread.h"
+
+#if ( __i386__ || __i386 || __amd64__ || __amd64 )
+#define cpu_pause() __asm__ ("pause")
+#else
+#define cpu_pause()
+#endif
+
+#define CACHELINE			64
+#define DEQUE_INIT_SIZE		256
+#define INJECT_INIT_SIZE	256
+#define STEAL_SPINS			64
+
+/*
+ * a task counts towards the group of the task that submitted it, tasks
+ * submitted from outside the pool towards the root group. a task gets a
+ * group of its own on its first submit and holds one count of it until
+ * it returns, so a group drops to zero only once the task and all it
+ * spawned have finished, and then counts its task off the parent group.
+ */
+struct pool_group {
+	int64_t pending;
+	struct pool_group *parent;
+};
+
+struct pool_task {
+	void (*fn)(void *);
+	void *args;
+	struct pool_group *group;
+};
+
+struct pool_array {
+	struct pool_array *retired;	/* older arrays, freed on destroy */
+	int64_t mask;
+	struct pool_task buf[];
+};
+
+/*
+ * Chase-Lev deque, see "Correct and Efficient Work-Stealing for Weak
+ * Memory Models" (Le et al.). tasks are stored by value: a thief may
+ * read a slot that is being overwritten, but then its CAS on top fails
+ * and the torn copy is discarded.
+ */
+struct pool_deque {
+	int64_t top __attribute__ ((aligned(CACHELINE)));
+	int64_t bottom __attribute__ ((aligned(CACHELINE)));
+	struct pool_array *array;
+};
+
+struct pool_worker {
+	struct pool_deque deque;
+	rtl_pool_t *pool;
+	rtl_thread_t *thread;
+	/* group the running task counts towards and its own, if any */
+	struct pool_group *parent;
+	struct pool_group *group;
+	uint32_t seed;
+	int index;
+} __attribute__ ((aligned(CACHELINE)));
+
+struct rtl_pool {
+	int nworkers;
+	int stop;
+	int nsleepers;
+	int nsearching;		/* workers spinning for work, they need no wakeup */
+	struct pool_group root __attribute__ ((aligned(CACHELINE)));
+	/* injection queue for submits from outside the pool */
+	rtl_mutex_lock_t *inject_lock;
+	struct pool_task *inject;
+	size_t inject_head;
+	size_t inject_len;
+	size_t inject_size;
+	/* parking of idle workers and of rtl_pool_wait callers */
+	rtl_mutex_lock_t *park_lock;
+	rtl_mutex_cond_t *park_cond;
+	rtl_mutex_cond_t *done_cond;
+	struct pool_worker *workers;
+};
+
+static __thread struct pool_worker *current_worker;
+
+static struct pool_array *array_new(int64_t size, struct pool_array *retired)
+{
+	struct pool_array *a;
+
+	a = malloc(sizeof(struct pool_array) + size * sizeof(struct pool_task));
+	if (!a) {
+		fprintf(stderr, "malloc pool_array failed!\n");
+		return NULL;
+	}
+	a->retired = retired;
+	a->mask = size - 1;
+	return a;
+}
+
+static int deque_push(struct pool_deque *q, const struct pool_task *task)
+{
+	int64_t b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED);
+	int64_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+	struct pool_array *a = __atomic_load_n(&q->array, __ATOMIC_RELAXED);
+
+	if (b - t > a->mask) {
+		struct pool_array *n = array_new((a->mask + 1) << 1, a);
+		int64_t i;
+
+		if (!n)
+			return -1;
+		for (i = t; i < b; i++)
+			n->buf[i & n->mask] = a->buf[i & a->mask];
+		__atomic_store_n(&q->array, n, __ATOMIC_RELEASE);
+		a = n;
+	}
+	a->buf[b & a->mask] = *task;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static int deque_take(struct pool_deque *q, struct pool_task *task)
+{
+	int64_t b = __atomic_load_n(&q->bottom, __ATOMIC_RELAXED) - 1;
+	struct pool_array *a = __atomic_load_n(&q->array, __ATOMIC_RELAXED);
+	int64_t t;
+	int ret = 0;
+
+	__atomic_store_n(&q->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&q->top, __ATOMIC_RELAXED);
+	if (t <= b) {
+		*task = a->buf[b & a->mask];
+		ret = 1;
+		if (t == b) {
+			/* last task, race the thieves for it */
+			if (!__atomic_compare_exchange_n(&q->top, &t, t + 1, 0,
+						__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				ret = 0;
+			__atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+		}
+	} else {
+		__atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+	return ret;
+}
+
+static int deque_steal(struct pool_deque *q, struct pool_task *task)
+{
+	int64_t t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+	int64_t b;
+	struct pool_array *a;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&q->bottom, __ATOMIC_ACQUIRE);
+	if (t >= b)
+		return 0;
+	a = __atomic_load_n(&q->array, __ATOMIC_ACQUIRE);
+	*task = a->buf[t & a->mask];
+	return __atomic_compare_exchange_n(&q->top, &t, t + 1, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static int deque_empty(struct pool_deque *q)
+{
+	return __atomic_load_n(&q->top, __ATOMIC_ACQUIRE) >=
+		__atomic_load_n(&q->bottom, __ATOMIC_ACQUIRE);
+}
+
+static int inject_push(rtl_pool_t *pool, const struct pool_task *task)
+{
+	rtl_mutex_lock(pool->inject_lock);
+	if (pool->inject_len == pool->inject_size) {
+		size_t size = pool->inject_size << 1;
+		struct pool_task *q = malloc(size * sizeof(struct pool_task));
+		size_t i;
+
+		if (!q) {
+			rtl_mutex_unlock(pool->inject_lock);
+			fprintf(stderr, "malloc pool injection queue failed!\n");
+			return -1;
+		}
+		for (i = 0; i < pool->inject_len; i++)
+			q[i] = pool->inject[(pool->inject_head + i) % pool->inject_size];
+		free(pool->inject);
+		pool->inject = q;
+		pool->inject_head = 0;
+		pool->inject_size = size;
+	}
+	pool->inject[(pool->inject_head + pool->inject_len) % pool->inject_size] = *task;
+	__atomic_store_n(&pool->inject_len, pool->inject_len + 1, __ATOMIC_RELEASE);
+	rtl_mutex_unlock(pool->inject_lock);
+	return 0;
+}
+
+static int inject_pop(rtl_pool_t *pool, struct pool_task *task)
+{
+	int ret = 0;
+
+	if (!__atomic_load_n(&pool->inject_len, __ATOMIC_ACQUIRE))
+		return 0;
+	rtl_mutex_lock(pool->inject_lock);
+	if (pool->inject_len) {
+		*task = pool->inject[pool->inject_head];
+		pool->inject_head = (pool->inject_head + 1) % pool->inject_size;
+		__atomic_store_n(&pool->inject_len, pool->inject_len - 1, __ATOMIC_RELEASE);
+		ret = 1;
+	}
+	rtl_mutex_unlock(pool->inject_lock);
+	return ret;
+}
+
+static uint32_t worker_rand(struct pool_worker *w)
+{
+	/* xorshift32 */
+	w->seed ^= w->seed << 13;
+	w->seed ^= w->seed >> 17;
+	w->seed ^= w->seed << 5;
+	return w->seed;
+}
+
+/* find a task for w, or for an outside thread when w is NULL */
+static int pool_find(rtl_pool_t *pool, struct pool_worker *w, struct pool_task *task)
+{
+	int i, start;
+
+	if (w && deque_take(&w->deque, task))
+		return 1;
+	if (inject_pop(pool, task))
+		return 1;
+	start = w ? worker_rand(w) % pool->nworkers : 0;
+	for (i = 0; i < pool->nworkers; i++) {
+		struct pool_worker *victim = &pool->workers[(start + i) % pool->nworkers];
+
+		if (victim != w && deque_steal(&victim->deque, task))
+			return 1;
+	}
+	return 0;
+}
+
+static int pool_has_work(rtl_pool_t *pool)
+{
+	int i;
+
+	if (__atomic_load_n(&pool->inject_len, __ATOMIC_ACQUIRE))
+		return 1;
+	for (i = 0; i < pool->nworkers; i++) {
+		if (!deque_empty(&pool->workers[i].deque))
+			return 1;
+	}
+	return 0;
+}
+
+/* count one task off g, finished groups count off their parent */
+static void group_done(rtl_pool_t *pool, struct pool_group *g)
+{
+	struct pool_group *parent;
+
+	while (__atomic_sub_fetch(&g->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+		if (g == &pool->root) {
+			rtl_mutex_lock(pool->park_lock);
+			rtl_mutex_cond_signal_all(pool->done_cond);
+			rtl_mutex_unlock(pool->park_lock);
+			return;
+		}
+		parent = g->parent;
+		free(g);
+		g = parent;
+	}
+}
+
+/* tasks run nested inside rtl_pool_wait, so the groups are stacked */
+static void pool_run(rtl_pool_t *pool, struct pool_worker *w,
+		struct pool_task *task)
+{
+	struct pool_group *parent = w->parent;
+	struct pool_group *group = w->group;
+
+	w->parent = task->group;
+	w->group = NULL;
+	task->fn(task->args);
+	group_done(pool, w->group ? w->group : task->group);
+	w->parent = parent;
+	w->group = group;
+}
+
+static void pool_wake(rtl_pool_t *pool)
+{
+	rtl_mutex_lock(pool->park_lock);
+	rtl_mutex_cond_signal(pool->park_cond);
+	rtl_mutex_unlock(pool->park_lock);
+}
+
+static void *pool_worker_loop(rtl_thread_t *t)
+{
+	struct pool_worker *w = (struct pool_worker *)t->args;
+	rtl_pool_t *pool = w->pool;
+	struct pool_task task;
+	int searching = 0;
+	int spins = 0;
+
+	current_worker = w;
+	for (;;) {
+		if (pool_find(pool, w, &task)) {
+			/*
+			 * the last searcher found work, hand the search over to a
+			 * sleeper in case more is queued
+			 */
+			if (searching) {
+				searching = 0;
+				if (__atomic_sub_fetch(&pool->nsearching, 1, __ATOMIC_SEQ_CST) == 0 &&
+					__atomic_load_n(&pool->nsleepers, __ATOMIC_SEQ_CST) &&
+					pool_has_work(pool))
+					pool_wake(pool);
+			}
+			pool_run(pool, w, &task);
+			spins = 0;
+			continue;
+		}
+		if (!searching) {
+			searching = 1;
+			__atomic_add_fetch(&pool->nsearching, 1, __ATOMIC_SEQ_CST);
+		}
+		if (++spins < STEAL_SPINS) {
+			cpu_pause();
+			continue;
+		}
+		spins = 0;
+		searching = 0;
+		__atomic_sub_fetch(&pool->nsearching, 1, __ATOMIC_SEQ_CST);
+
+		/*
+		 * announce the sleeper before the last look for work, a submitter
+		 * pushes before it reads nsleepers, so one of the two sees the other
+		 */
+		rtl_mutex_lock(pool->park_lock);
+		__atomic_add_fetch(&pool->nsleepers, 1, __ATOMIC_SEQ_CST);
+		if (!pool_has_work(pool) && !__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE))
+			rtl_mutex_cond_wait(pool->park_lock, pool->park_cond, 0);
+		__atomic_sub_fetch(&pool->nsleepers, 1, __ATOMIC_SEQ_CST);
+		rtl_mutex_unlock(pool->park_lock);
+
+		if (__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE) && !pool_has_work(pool))
+			break;
+	}
+	current_worker = NULL;
+	return NULL;
+}
+
+rtl_pool_t *rtl_pool_create(int nworkers)
+{
+	rtl_pool_t *pool;
+	rtl_thread_attr_t attr;
+	char name[32];
+	int i;
+
+	if (nworkers <= 0)
+		nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nworkers <= 0)
+		nworkers = 1;
+
+	pool = calloc(1, sizeof(rtl_pool_t));
+	if (!pool) {
+		fprintf(stderr, "calloc rtl_pool_t failed!\n");
+		return NULL;
+	}
+	pool->workers = calloc(nworkers, sizeof(struct pool_worker));
+	pool->inject_size = INJECT_INIT_SIZE;
+	pool->inject = malloc(INJECT_INIT_SIZE * sizeof(struct pool_task));
+	pool->inject_lock = rtl_mutex_lock_init();
+	pool->park_lock = rtl_mutex_lock_init();
+	pool->park_cond = rtl_mutex_cond_init();
+	pool->done_cond = rtl_mutex_cond_init();
+	if (!pool->workers || !pool->inject || !pool->inject_lock ||
+		!pool->park_lock || !pool->park_cond || !pool->done_cond) {
+		fprintf(stderr, "rtl_pool_create: out of memory\n");
+		goto err;
+	}
+	pool->nworkers = nworkers;
+	for (i = 0; i < nworkers; i++) {
+		struct pool_worker *w = &pool->workers[i];
+
+		w->pool = pool;
+		w->index = i;
+		w->seed = 2463534242u + i * 2654435761u;
+		w->deque.array = array_new(DEQUE_INIT_SIZE, NULL);
+		if (!w->deque.array)
+			goto err;
+	}
+	/* workers never touch the per-thread sync objects */
+	rtl_thread_attr_init(&attr);
+	attr.lazy_sync = 1;
+	for (i = 0; i < nworkers; i++) {
+		snprintf(name, sizeof(name), "pool-worker-%d", i);
+		pool->workers[i].thread = rtl_thread_create_attr(pool_worker_loop, name,
+				&pool->workers[i], &attr);
+		if (!pool->workers[i].thread)
+			goto err;
+	}
+	return pool;
+
+err:
+	rtl_pool_destroy(pool);
+	return NULL;
+}
+
+void rtl_pool_destroy(rtl_pool_t *pool)
+{
+	struct pool_array *a, *next;
+	int i;
+
+	if (!pool)
+		return;
+	if (pool->park_lock) {
+		rtl_pool_wait(pool);
+		rtl_mutex_lock(pool->park_lock);
+		__atomic_store_n(&pool->stop, 1, __ATOMIC_RELEASE);
+		rtl_mutex_cond_signal_all(pool->park_cond);
+		rtl_mutex_unlock(pool->park_lock);
+	}
+	for (i = 0; pool->workers && i < pool->nworkers; i++) {
+		if (pool->workers[i].thread)
+			rtl_thread_destroy(pool->workers[i].thread);
+		for (a = pool->workers[i].deque.array; a; a = next) {
+			next = a->retired;
+			free(a);
+		}
+	}
+	free(pool->workers);
+	free(pool->inject);
+	rtl_mutex_cond_deinit(pool->done_cond);
+	rtl_mutex_cond_deinit(pool->park_cond);
+	rtl_mutex_lock_deinit(pool->park_lock);
+	rtl_mutex_lock_deinit(pool->inject_lock);
+	free(pool);
+}
+
+int rtl_pool_size(const rtl_pool_t *pool)
+{
+	return pool->nworkers;
+}
+
+int rtl_pool_submit(rtl_pool_t *pool, void (*fn)(void *), void *args)
+{
+	struct pool_worker *w = current_worker;
+	struct pool_task task;
+	int ret;
+
+	if (!pool || !fn)
+		return -1;
+	task.fn = fn;
+	task.args = args;
+	if (w && w->pool == pool) {
+		if (!w->group) {
+			w->group = malloc(sizeof(struct pool_group));
+			if (!w->group) {
+				fprintf(stderr, "malloc pool_group failed!\n");
+				return -1;
+			}
+			w->group->pending = 1;
+			w->group->parent = w->parent;
+		}
+		task.group = w->group;
+	} else {
+		task.group = &pool->root;
+	}
+	__atomic_add_fetch(&task.group->pending, 1, __ATOMIC_RELAXED);
+	if (w && w->pool == pool)
+		ret = deque_push(&w->deque, &task);
+	else
+		ret = inject_push(pool, &task);
+	if (ret < 0) {
+		group_done(pool, task.group);
+		return -1;
+	}
+
+	/*
+	 * pairs with the sleeper announcement in pool_worker_loop, a worker
+	 * still searching will find the task or re-check before it parks
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pool->nsleepers, __ATOMIC_RELAXED) &&
+		!__atomic_load_n(&pool->nsearching, __ATOMIC_RELAXED))
+		pool_wake(pool);
+	return 0;
+}
+
+void rtl_pool_wait(rtl_pool_t *pool)
+{
+	struct pool_worker *w = current_worker;
+	struct pool_task task;
+
+	if (w && w->pool == pool) {
+		/*
+		 * a worker must not block, it helps until only the count held by
+		 * its running task is left in that task's group
+		 */
+		while (w->group && __atomic_load_n(&w->group->pending, __ATOMIC_ACQUIRE) > 1) {
+			if (pool_find(pool, w, &task))
+				pool_run(pool, w, &task);
+			else
+				sched_yield();
+		}
+		return;
+	}
+	rtl_mutex_lock(pool->park_lock);
+	while (__atomic_load_n(&pool->root.pending, __ATOMIC_ACQUIRE))
+		rtl_mutex_cond_wait(pool->park_lock, pool->done_cond, 0);
+	rtl_mutex_unlock(pool->park_lock);
+}
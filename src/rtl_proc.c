@@ -56,11 +56,34 @@ int rtl_proc_spawn(rtl_spawn_proc_pt proc, void *args, char *name, int respawn)
 	return pid;
 }
 
+static void proc_exited(pid_t pid, int status)
+{
+	int i;
+	char *proc_name = "unknown process";
+
+	for (i = 0; i < rtl_last_proc; i++) {
+		if (rtl_processes[i].pid == pid) {
+			rtl_processes[i].pid = -1;
+			/* respawn process */
+			rtl_proc_spawn(NULL, NULL, NULL, 1);
+			proc_name = rtl_processes[i].name;
+			break;
+		}
+	}
+
+	if (WTERMSIG(status)) {
+		rtl_log_write(RTL_LOG_INFO, "%s(%d) exited on signal %d", proc_name, pid,
+					  WTERMSIG(status));
+	} else {
+		rtl_log_write(RTL_LOG_INFO, "%s(%d) exited with code %d", proc_name, pid,
+					  WEXITSTATUS(status));
+	}
+}
+
 void rtl_proc_wait(void)
 {
 	pid_t pid;
-	int i, status;
-	char *proc_name;
+	int status;
 
 	for (;;) {
 		pid = waitpid(-1, &status, 0);
@@ -68,25 +91,29 @@ void rtl_proc_wait(void)
 			rtl_log_write(RTL_LOG_ERR, "waitpid error: %s", strerror(errno));
 			continue;
 		}
+		proc_exited(pid, status);
+	}
+}
 
-		proc_name = "unknown process";
-
-		for (i = 0; i < rtl_last_proc; i++) {
-			if (rtl_processes[i].pid == pid) {
-				rtl_processes[i].pid = -1;
-				/* respawn process */
-				rtl_proc_spawn(NULL, NULL, NULL, 1);
-				proc_name = rtl_processes[i].name;
-				break;
-			}
-		}
+int rtl_proc_reap(void)
+{
+	pid_t pid;
+	int status;
+	int n = 0;
 
-		if (WTERMSIG(status)) {
-			rtl_log_write(RTL_LOG_INFO, "%s(%d) exited on signal %d", proc_name, pid,
-						  WTERMSIG(status));
-		} else {
-			rtl_log_write(RTL_LOG_INFO, "%s(%d) exited with code %d", proc_name, pid,
-						  WEXITSTATUS(status));
+	for (;;) {
+		pid = waitpid(-1, &status, WNOHANG);
+		if (pid == 0)
+			break;
+		if (pid == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno != ECHILD)
+				rtl_log_write(RTL_LOG_ERR, "waitpid error: %s", strerror(errno));
+			break;
 		}
+		proc_exited(pid, status);
+		n++;
 	}
+	return n;
 }
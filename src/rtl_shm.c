@@ -1,14 +1,24 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "rtl_shm.h"
-#include "rtl_sem.h"
 
 #define HEAP_MAGIC				0x1ea0
 
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE		0x100000
+#endif
+
 #define ALIGN_SIZE				4
 #define ALIGN(size, align)		(((size) + (align) - 1) & ~((align) - 1))
 #define ALIGN_DOWN(size, align)	((size) & ~((align) - 1))
@@ -47,7 +57,475 @@ static void plug_holes(rtl_shm_ctl_block_t *scb, struct rtl_heap_mem *mem)
 	}
 }
 
-static rtl_shm_ctl_block_t *heap_init(void *begin_addr, void *end_addr)
+/* rebuild prev links, merge free neighbours and find lfree again */
+static void ff_repair(rtl_shm_ctl_block_t *scb)
+{
+	size_t end = scb->mem_size_aligned + SIZEOF_STRUCT_MEM;
+	size_t ptr = 0, prev = 0;
+	struct rtl_heap_mem *mem, *pmem = NULL;
+
+	scb->lfree = scb->heap_end;
+	while (ptr < end) {
+		mem = (struct rtl_heap_mem *)&scb->heap_ptr[ptr];
+		if (mem->next <= ptr || mem->next > end) {
+			/* torn block, keep the rest of the heap out of use */
+			mem->next = end;
+			mem->used = 1;
+		}
+		if (pmem && !pmem->used && !mem->used) {
+			pmem->next = mem->next;
+		} else {
+			mem->prev = prev;
+			prev = ptr;
+			pmem = mem;
+			if (!mem->used && scb->lfree == scb->heap_end)
+				scb->lfree = mem;
+		}
+		ptr = mem->next;
+	}
+	scb->heap_end->prev = prev;
+}
+
+/*
+ * TLSF: a free block of size s is kept in list [fl][sl], fl being the
+ * power of two below s and sl one of SL_COUNT equal steps above it.
+ * a bitmap per level finds the first non-empty list that only holds
+ * blocks large enough in constant time. blocks are addressed by their
+ * offset from heap_ptr, 0 is never a block since the lists live there.
+ */
+#define TLSF_ALIGN				8
+#define TLSF_SL_LOG2			5
+#define TLSF_SL_COUNT			(1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT			(TLSF_SL_LOG2 + 3)
+#define TLSF_FL_MAX				40
+#define TLSF_FL_COUNT			(TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+#define TLSF_SMALL_BLOCK		(1 << TLSF_FL_SHIFT)
+
+#define TLSF_BLOCK_FREE			1
+#define TLSF_PREV_FREE			2
+
+struct tlsf_ctl {
+	uint64_t fl_bitmap;
+	uint32_t sl_bitmap[TLSF_FL_COUNT];
+	size_t heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+};
+
+/* the free list links overlay the data of a free block */
+struct tlsf_block {
+	size_t prev_phys;		/* valid only while the previous block is free */
+	size_t size;			/* data size | TLSF_BLOCK_FREE | TLSF_PREV_FREE */
+	size_t next_free;
+	size_t prev_free;
+};
+
+#define TLSF_HDR				offsetof(struct tlsf_block, next_free)
+#define TLSF_MIN				(sizeof(struct tlsf_block) - TLSF_HDR)
+#define TLSF_BLOCK_MAX			(((size_t)1 << TLSF_FL_MAX) - TLSF_ALIGN)
+
+#define tlsf_ctl(scb)			((struct tlsf_ctl *)ALIGN((size_t)(scb)->heap_ptr, TLSF_ALIGN))
+#define tlsf_block(scb, off)	((struct tlsf_block *)&(scb)->heap_ptr[off])
+#define tlsf_size(b)			((b)->size & ~(size_t)(TLSF_BLOCK_FREE | TLSF_PREV_FREE))
+
+static int tlsf_fls(size_t size)
+{
+	return sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(size);
+}
+
+static void tlsf_mapping(size_t size, int *fl, int *sl)
+{
+	int f;
+
+	if (size < TLSF_SMALL_BLOCK) {
+		*fl = 0;
+		*sl = size / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT);
+		return;
+	}
+	f = tlsf_fls(size);
+	*sl = (size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+	*fl = f - (TLSF_FL_SHIFT - 1);
+}
+
+static void tlsf_insert(rtl_shm_ctl_block_t *scb, size_t off)
+{
+	struct tlsf_ctl *ctl = tlsf_ctl(scb);
+	struct tlsf_block *b = tlsf_block(scb, off);
+	int fl, sl;
+
+	tlsf_mapping(tlsf_size(b), &fl, &sl);
+	b->next_free = ctl->heads[fl][sl];
+	b->prev_free = 0;
+	if (b->next_free)
+		tlsf_block(scb, b->next_free)->prev_free = off;
+	ctl->heads[fl][sl] = off;
+	ctl->fl_bitmap |= (uint64_t)1 << fl;
+	ctl->sl_bitmap[fl] |= 1U << sl;
+}
+
+static void tlsf_remove(rtl_shm_ctl_block_t *scb, size_t off)
+{
+	struct tlsf_ctl *ctl = tlsf_ctl(scb);
+	struct tlsf_block *b = tlsf_block(scb, off);
+	int fl, sl;
+
+	tlsf_mapping(tlsf_size(b), &fl, &sl);
+	if (b->next_free)
+		tlsf_block(scb, b->next_free)->prev_free = b->prev_free;
+	if (b->prev_free) {
+		tlsf_block(scb, b->prev_free)->next_free = b->next_free;
+		return;
+	}
+	ctl->heads[fl][sl] = b->next_free;
+	if (!b->next_free) {
+		ctl->sl_bitmap[fl] &= ~(1U << sl);
+		if (!ctl->sl_bitmap[fl])
+			ctl->fl_bitmap &= ~((uint64_t)1 << fl);
+	}
+}
+
+/* first free block of at least size bytes, 0 if there is none */
+static size_t tlsf_find(rtl_shm_ctl_block_t *scb, size_t size)
+{
+	struct tlsf_ctl *ctl = tlsf_ctl(scb);
+	uint64_t fl_map;
+	uint32_t sl_map;
+	int fl, sl;
+
+	/* round up to the next list, every block in it is large enough */
+	if (size >= TLSF_SMALL_BLOCK)
+		size += ((size_t)1 << (tlsf_fls(size) - TLSF_SL_LOG2)) - 1;
+	tlsf_mapping(size, &fl, &sl);
+	if (fl >= TLSF_FL_COUNT)
+		return 0;
+
+	sl_map = ctl->sl_bitmap[fl] & (~0U << sl);
+	if (!sl_map) {
+		fl_map = ctl->fl_bitmap & (~(uint64_t)0 << (fl + 1));
+		if (!fl_map)
+			return 0;
+		fl = __builtin_ctzll(fl_map);
+		sl_map = ctl->sl_bitmap[fl];
+	}
+	sl = __builtin_ctz(sl_map);
+	return ctl->heads[fl][sl];
+}
+
+/* mark the used block at off free, merge it with free neighbours */
+static void tlsf_release(rtl_shm_ctl_block_t *scb, size_t off)
+{
+	struct tlsf_block *b = tlsf_block(scb, off);
+	struct tlsf_block *n;
+	size_t size = tlsf_size(b);
+	size_t prev;
+
+	if (b->size & TLSF_PREV_FREE) {
+		prev = b->prev_phys;
+		tlsf_remove(scb, prev);
+		size += TLSF_HDR + tlsf_size(tlsf_block(scb, prev));
+		off = prev;
+		b = tlsf_block(scb, off);
+	}
+	n = tlsf_block(scb, off + TLSF_HDR + size);
+	if (n->size & TLSF_BLOCK_FREE) {
+		tlsf_remove(scb, off + TLSF_HDR + size);
+		size += TLSF_HDR + tlsf_size(n);
+	}
+	/* the block before a free block is always used */
+	b->size = size | TLSF_BLOCK_FREE;
+	n = tlsf_block(scb, off + TLSF_HDR + size);
+	n->prev_phys = off;
+	n->size |= TLSF_PREV_FREE;
+	tlsf_insert(scb, off);
+}
+
+/*
+ * split the tail beyond size off the block at off and make it a free
+ * block. the headers are written so that a process dying at any point
+ * leaves a chain tlsf_repair() can walk, with nothing but the block at
+ * off marked used.
+ */
+static void tlsf_trim(rtl_shm_ctl_block_t *scb, size_t off, size_t size)
+{
+	struct tlsf_block *b = tlsf_block(scb, off);
+	struct tlsf_block *r, *n;
+	size_t rest = tlsf_size(b);
+	size_t roff = off + TLSF_HDR + size;
+
+	if (rest < size + TLSF_HDR + TLSF_MIN)
+		return;
+	r = tlsf_block(scb, roff);
+	r->size = (rest - size - TLSF_HDR) | TLSF_BLOCK_FREE |
+		((b->size & TLSF_BLOCK_FREE) ? TLSF_PREV_FREE : 0);
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	b->size = size | (b->size & (TLSF_BLOCK_FREE | TLSF_PREV_FREE));
+
+	n = tlsf_block(scb, roff + TLSF_HDR + tlsf_size(r));
+	if (n->size & TLSF_BLOCK_FREE) {
+		tlsf_remove(scb, roff + TLSF_HDR + tlsf_size(r));
+		r->size += TLSF_HDR + tlsf_size(n);
+		n = tlsf_block(scb, roff + TLSF_HDR + tlsf_size(r));
+	}
+	n->prev_phys = roff;
+	n->size |= TLSF_PREV_FREE;
+	tlsf_insert(scb, roff);
+}
+
+/* mark the block at off used, it must be out of the lists already */
+static void tlsf_use(rtl_shm_ctl_block_t *scb, size_t off)
+{
+	struct tlsf_block *b = tlsf_block(scb, off);
+
+	b->size &= ~(size_t)TLSF_BLOCK_FREE;
+	tlsf_block(scb, off + TLSF_HDR + tlsf_size(b))->size &= ~(size_t)TLSF_PREV_FREE;
+}
+
+static size_t tlsf_adjust(size_t size)
+{
+	size = ALIGN(size, TLSF_ALIGN);
+	return size < TLSF_MIN ? TLSF_MIN : size;
+}
+
+/* offset of the lowest block, right behind the lists */
+static size_t tlsf_first(rtl_shm_ctl_block_t *scb)
+{
+	return ALIGN((size_t)tlsf_ctl(scb) + sizeof(struct tlsf_ctl), TLSF_ALIGN) -
+		(size_t)scb->heap_ptr;
+}
+
+static int tlsf_init(rtl_shm_ctl_block_t *scb, size_t heap_size)
+{
+	size_t first = tlsf_first(scb);
+	size_t end = ALIGN_DOWN((size_t)scb->heap_ptr + heap_size, TLSF_ALIGN) -
+		(size_t)scb->heap_ptr;
+	struct tlsf_block *b;
+	size_t size;
+
+	/* room for the first block and the end marker */
+	if (end < first + 2 * TLSF_HDR + TLSF_MIN)
+		return -1;
+	size = end - first - 2 * TLSF_HDR;
+	if (size > TLSF_BLOCK_MAX)
+		size = TLSF_BLOCK_MAX;
+
+	memset(tlsf_ctl(scb), 0, sizeof(struct tlsf_ctl));
+	b = tlsf_block(scb, first);
+	b->size = size;
+	/* used block of size 0, never merged */
+	b = tlsf_block(scb, first + TLSF_HDR + size);
+	b->size = 0;
+	scb->heap_end = (struct rtl_heap_mem *)b;
+	scb->mem_size_aligned = size;
+	scb->lfree = NULL;
+	tlsf_release(scb, first);
+	return 0;
+}
+
+/* walk the blocks to rebuild the lists, merging runs of free blocks */
+static void tlsf_repair(rtl_shm_ctl_block_t *scb)
+{
+	size_t end = (uint8_t *)scb->heap_end - scb->heap_ptr;
+	size_t off = tlsf_first(scb);
+	size_t run = 0;
+	struct tlsf_block *b;
+
+	memset(tlsf_ctl(scb), 0, sizeof(struct tlsf_ctl));
+	for (;;) {
+		b = tlsf_block(scb, off);
+		if (off == end || !(b->size & TLSF_BLOCK_FREE)) {
+			if (run) {
+				tlsf_block(scb, run)->size = (off - run - TLSF_HDR) | TLSF_BLOCK_FREE;
+				tlsf_insert(scb, run);
+				b->prev_phys = run;
+				b->size |= TLSF_PREV_FREE;
+				run = 0;
+			} else {
+				b->size &= ~(size_t)TLSF_PREV_FREE;
+			}
+			if (off == end)
+				break;
+		} else if (!run) {
+			run = off;
+		}
+		if (off + TLSF_HDR + tlsf_size(b) > end) {
+			/* torn block, stretch it to the end marker */
+			b->size = (end - off - TLSF_HDR) |
+				(b->size & (TLSF_BLOCK_FREE | TLSF_PREV_FREE));
+		}
+		off += TLSF_HDR + tlsf_size(b);
+	}
+}
+
+/*
+ * any error but a dead owner, such as ENOTRECOVERABLE once a repair was
+ * abandoned or EINVAL on a clobbered segment, leaves the heap unlocked
+ * and fails the operation.
+ */
+static int heap_lock(rtl_shm_ctl_block_t *scb)
+{
+	int ret = pthread_mutex_lock(&scb->heap_lock);
+
+	if (ret == 0)
+		return 0;
+	if (ret != EOWNERDEAD) {
+		fprintf(stderr, "rtl_shm heap lock failed: %s\n", strerror(ret));
+		return -1;
+	}
+	/* the previous owner died, maybe in the middle of an update */
+	fprintf(stderr, "rtl_shm heap lock owner died, repairing heap\n");
+	if (scb->mode == RTL_SHM_TLSF)
+		tlsf_repair(scb);
+	else
+		ff_repair(scb);
+	pthread_mutex_consistent(&scb->heap_lock);
+	return 0;
+}
+
+static void heap_unlock(rtl_shm_ctl_block_t *scb)
+{
+	pthread_mutex_unlock(&scb->heap_lock);
+}
+
+static int heap_lock_init(pthread_mutex_t *lock)
+{
+	pthread_mutexattr_t attr;
+	int ret;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	ret = pthread_mutex_init(lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	if (ret) {
+		fprintf(stderr, "pthread_mutex_init failed: %s\n", strerror(ret));
+		return -1;
+	}
+	return 0;
+}
+
+/* tlsf_malloc() and tlsf_free() are called with the heap locked */
+static void *tlsf_malloc(rtl_shm_ctl_block_t *scb, size_t size)
+{
+	size_t off;
+
+	if (size > scb->mem_size_aligned)
+		return NULL;
+	size = tlsf_adjust(size);
+	off = tlsf_find(scb, size);
+	if (!off)
+		return NULL;
+	/* split while the block is still free */
+	tlsf_remove(scb, off);
+	tlsf_trim(scb, off, size);
+	tlsf_use(scb, off);
+
+	return &scb->heap_ptr[off + TLSF_HDR];
+}
+
+static void tlsf_free(rtl_shm_ctl_block_t *scb, void *rmem)
+{
+	size_t off = (uint8_t *)rmem - scb->heap_ptr - TLSF_HDR;
+
+	/* ignore a double free */
+	if (!(tlsf_block(scb, off)->size & TLSF_BLOCK_FREE))
+		tlsf_release(scb, off);
+}
+
+static int heap_contains(rtl_shm_ctl_block_t *scb, void *rmem)
+{
+	return (uint8_t *)rmem >= (uint8_t *)scb->heap_ptr &&
+		(uint8_t *)rmem < (uint8_t *)scb->heap_end;
+}
+
+/*
+ * with RTL_SHM_DEBUG every block starts with a header recording the
+ * requested size and the return address of the allocating call. blocks
+ * held by a cache record DEBUG_CACHED instead. tags are only written with
+ * the heap locked, so a walk from another process never sees a torn one.
+ */
+#ifdef RTL_SHM_DEBUG
+struct shm_debug {
+	void *caller;
+	size_t size;
+};
+
+#define DEBUG_HDR				ALIGN(sizeof(struct shm_debug), 8)
+
+static void *debug_tag(void *p, size_t size, void *caller)
+{
+	struct shm_debug *d = (struct shm_debug *)p;
+
+	if (!p)
+		return NULL;
+	d->caller = caller;
+	d->size = size;
+	return (uint8_t *)p + DEBUG_HDR;
+}
+
+#define debug_real(p)			((p) ? (void *)((uint8_t *)(p) - DEBUG_HDR) : NULL)
+#define debug_info(p)			((struct shm_debug *)(p))
+#define DEBUG_CACHED			((void *)-1)
+
+/* retag a block handed over by a cache, which needs the lock just for that */
+static void *debug_retag(rtl_shm_ctl_block_t *scb, void *p, size_t size,
+		void *caller)
+{
+	if (heap_lock(scb) < 0)
+		return p;
+	debug_tag(debug_real(p), size, caller);
+	heap_unlock(scb);
+	return p;
+}
+#else
+#define DEBUG_HDR				0
+#define debug_tag(p, size, caller)	(p)
+#define debug_real(p)			(p)
+#define DEBUG_CACHED			NULL
+#define debug_retag(scb, p, size, caller)	(p)
+#endif
+
+static void *heap_alloc(rtl_shm_ctl_block_t *scb, size_t size);
+static void heap_free(rtl_shm_ctl_block_t *scb, void *rmem);
+
+/* rmem and newsize include the debug header, returns the tagged pointer */
+static void *tlsf_realloc(rtl_shm_ctl_block_t *scb, void *rmem, size_t newsize,
+		size_t tag, void *caller)
+{
+	size_t off = (uint8_t *)rmem - scb->heap_ptr - TLSF_HDR;
+	struct tlsf_block *b, *n;
+	size_t size;
+	void *nmem;
+
+	newsize = tlsf_adjust(newsize);
+	if (heap_lock(scb) < 0)
+		return NULL;
+	b = tlsf_block(scb, off);
+	size = tlsf_size(b);
+	n = tlsf_block(scb, off + TLSF_HDR + size);
+	if (newsize > size && (n->size & TLSF_BLOCK_FREE) &&
+		size + TLSF_HDR + tlsf_size(n) >= newsize) {
+		/* grow in place into the free block behind */
+		tlsf_remove(scb, off + TLSF_HDR + size);
+		b->size += TLSF_HDR + tlsf_size(n);
+		tlsf_use(scb, off);
+		size = newsize;
+	}
+	if (newsize <= size) {
+		tlsf_trim(scb, off, newsize);
+		rmem = debug_tag(rmem, tag, caller);
+		heap_unlock(scb);
+		return rmem;
+	}
+	nmem = debug_tag(heap_alloc(scb, newsize), tag, caller);
+	heap_unlock(scb);
+
+	if (nmem != NULL) {
+		memcpy(nmem, (uint8_t *)rmem + DEBUG_HDR, size - DEBUG_HDR);
+		heap_free(scb, rmem);
+	}
+
+	return nmem;
+}
+
+static rtl_shm_ctl_block_t *heap_init(void *begin_addr, void *end_addr, int mode)
 {
 	rtl_shm_ctl_block_t *scb;
 	struct rtl_heap_mem *mem;
@@ -66,11 +544,18 @@ static rtl_shm_ctl_block_t *heap_init(void *begin_addr, void *end_addr)
 
 	scb = (rtl_shm_ctl_block_t *)begin_align;
 
+	scb->mode = mode;
 	scb->heap_addr = begin_addr;
 	scb->mem_size_aligned = mem_size_aligned;
 	/* point to begin address of heap */
 	scb->heap_ptr = (uint8_t *)(begin_align + SIZEOF_STRUCT_SHM);
 
+	if (mode == RTL_SHM_TLSF) {
+		if (tlsf_init(scb, mem_size_aligned + 2 * SIZEOF_STRUCT_MEM) < 0)
+			return NULL;
+		goto lock;
+	}
+
 	/* initialize the start of the heap */
 	mem        = (struct rtl_heap_mem *)scb->heap_ptr;
 	mem->magic = HEAP_MAGIC;
@@ -85,22 +570,22 @@ static rtl_shm_ctl_block_t *heap_init(void *begin_addr, void *end_addr)
 	scb->heap_end->next  = scb->mem_size_aligned + SIZEOF_STRUCT_MEM;
 	scb->heap_end->prev  = scb->mem_size_aligned + SIZEOF_STRUCT_MEM;
 
-	scb->heap_sem_id = rtl_sem_init(1);
-	if (scb->heap_sem_id < 0)
-		return NULL;
-
-	if (rtl_sem_set(scb->heap_sem_id, 1) < 0) {
-		rtl_sem_del(scb->heap_sem_id);
-		return NULL;
-	}
-
 	/* initialize the lowest-free pointer to the start of the heap */
 	scb->lfree = (struct rtl_heap_mem *)scb->heap_ptr;
 
+lock:
+	if (heap_lock_init(&scb->heap_lock) < 0)
+		return NULL;
+
 	return scb;
 }
 
 rtl_shm_ctl_block_t *rtl_shm_init(size_t size)
+{
+	return rtl_shm_init_mode(size, RTL_SHM_FIRST_FIT);
+}
+
+rtl_shm_ctl_block_t *rtl_shm_init_mode(size_t size, int mode)
 {
 	int shm_id;
 	uint8_t *addr;
@@ -123,7 +608,7 @@ rtl_shm_ctl_block_t *rtl_shm_init(size_t size)
 		return NULL;
 	}
 
-	scb = heap_init(addr, addr + size);
+	scb = heap_init(addr, addr + size, mode);
 	if (!scb)
 		goto err;
 
@@ -134,25 +619,170 @@ err:
 	return NULL;
 }
 
+static size_t huge_page_size(void)
+{
+	size_t size = 2 * 1024 * 1024;
+	char line[128];
+	FILE *fp;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (!fp)
+		return size;
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "Hugepagesize: %zu kB", &size) == 1) {
+			size *= 1024;
+			break;
+		}
+	}
+	fclose(fp);
+	return size;
+}
+
+rtl_shm_ctl_block_t *rtl_shm_create(const char *name, size_t size, int mode, int flags)
+{
+	rtl_shm_ctl_block_t *scb;
+	uint8_t *addr;
+	int fd;
+
+	if (!name || name[0] != '/' || strchr(name + 1, '/') ||
+		strlen(name) >= sizeof(scb->handle) || size == 0) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return NULL;
+	}
+
+	if (flags & RTL_SHM_HUGETLB) {
+		/* tmpfs cannot hold hugetlb pages, a memfd on hugetlbfs can */
+		size = ALIGN(size, huge_page_size());
+		fd = memfd_create(name + 1, MFD_HUGETLB | MFD_CLOEXEC);
+	} else {
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	}
+	if (fd < 0) {
+		fprintf(stderr, "create shm %s failed: %s\n", name, strerror(errno));
+		return NULL;
+	}
+	if (ftruncate(fd, size) < 0) {
+		fprintf(stderr, "ftruncate(%zu) failed: %s\n", size, strerror(errno));
+		goto err;
+	}
+
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		fprintf(stderr, "mmap(%zu) failed: %s\n", size, strerror(errno));
+		goto err;
+	}
+	if ((flags & RTL_SHM_THP) && madvise(addr, size, MADV_HUGEPAGE) < 0)
+		fprintf(stderr, "madvise(MADV_HUGEPAGE) failed: %s\n", strerror(errno));
+
+	scb = heap_init(addr, addr + size, mode);
+	if (!scb) {
+		munmap(addr, size);
+		goto err;
+	}
+	scb->map_size = size;
+
+	if (flags & RTL_SHM_HUGETLB) {
+		/* the memfd lives as long as this process keeps it open */
+		snprintf(scb->handle, sizeof(scb->handle), "/proc/%d/fd/%d", getpid(), fd);
+		scb->memfd = fd;
+		scb->memfd_pid = getpid();
+	} else {
+		strcpy(scb->handle, name);
+		close(fd);
+	}
+	return scb;
+
+err:
+	close(fd);
+	if (!(flags & RTL_SHM_HUGETLB))
+		shm_unlink(name);
+	return NULL;
+}
+
+rtl_shm_ctl_block_t *rtl_shm_attach(const char *handle)
+{
+	rtl_shm_ctl_block_t hdr;
+	uint8_t *addr;
+	struct stat st;
+	int fd;
+
+	if (!handle || handle[0] != '/') {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return NULL;
+	}
+
+	/* a shm name has no other slash than the leading one */
+	if (strchr(handle + 1, '/'))
+		fd = open(handle, O_RDWR | O_CLOEXEC);
+	else
+		fd = shm_open(handle, O_RDWR | O_CLOEXEC, 0);
+	if (fd < 0) {
+		fprintf(stderr, "open shm %s failed: %s\n", handle, strerror(errno));
+		return NULL;
+	}
+
+	/* the control block starts the segment */
+	if (fstat(fd, &st) < 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+		hdr.map_size != (size_t)st.st_size || hdr.heap_addr == NULL) {
+		fprintf(stderr, "%s is not an rtl_shm segment\n", handle);
+		close(fd);
+		return NULL;
+	}
+
+	addr = mmap(hdr.heap_addr, hdr.map_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		fprintf(stderr, "mmap at %p failed: %s\n", hdr.heap_addr, strerror(errno));
+		return NULL;
+	}
+	if (addr != hdr.heap_addr) {
+		/* kernels before 4.17 take the address as a hint only */
+		fprintf(stderr, "mmap at %p failed: address in use\n", hdr.heap_addr);
+		munmap(addr, hdr.map_size);
+		return NULL;
+	}
+
+	return (rtl_shm_ctl_block_t *)ALIGN((size_t)addr, ALIGN_SIZE);
+}
+
+int rtl_shm_unlink(const char *name)
+{
+	return shm_unlink(name);
+}
+
 /* must be called by last process */
 int rtl_shm_sem_del(rtl_shm_ctl_block_t *scb)
 {
-	return rtl_sem_del(scb->heap_sem_id);
+	return pthread_mutex_destroy(&scb->heap_lock) ? -1 : 0;
 }
 
 int rtl_shm_mem_del(rtl_shm_ctl_block_t *scb)
 {
-	return shmdt(scb->heap_addr);
+	int fd = -1;
+	int ret;
+
+	if (!scb->map_size)
+		return shmdt(scb->heap_addr);
+	/* attached processes and forked children do not own the memfd */
+	if (scb->memfd_pid == getpid())
+		fd = scb->memfd;
+	ret = munmap(scb->heap_addr, scb->map_size);
+	if (fd >= 0)
+		close(fd);
+	return ret;
 }
 
-void *rtl_shm_malloc(rtl_shm_ctl_block_t *scb, size_t size)
+/* ff_malloc() and ff_free() are called with the heap locked */
+static void *ff_malloc(rtl_shm_ctl_block_t *scb, size_t size)
 {
 	size_t ptr, ptr2;
 	struct rtl_heap_mem *mem, *mem2;
 
-	if (size == 0)
-		return NULL;
-
 	/* alignment size */
 	size = ALIGN(size, ALIGN_SIZE);
 
@@ -164,9 +794,6 @@ void *rtl_shm_malloc(rtl_shm_ctl_block_t *scb, size_t size)
 	if (size < MIN_SIZE_ALIGNED)
 		size = MIN_SIZE_ALIGNED;
 
-	/* take memory semaphore */
-	rtl_sem_p(scb->heap_sem_id);
-
 	for (ptr = (uint8_t *)scb->lfree - scb->heap_ptr;
 		 ptr < scb->mem_size_aligned - size;
 		 ptr = ((struct rtl_heap_mem *)&scb->heap_ptr[ptr])->next) {
@@ -222,19 +849,20 @@ void *rtl_shm_malloc(rtl_shm_ctl_block_t *scb, size_t size)
 					scb->lfree = (struct rtl_heap_mem *)&scb->heap_ptr[scb->lfree->next];
 			}
 
-			rtl_sem_v(scb->heap_sem_id);
-
 			/* return the memory data except mem struct */
 			return (uint8_t *)mem + SIZEOF_STRUCT_MEM;
 		}
 	}
 
-	rtl_sem_v(scb->heap_sem_id);
-
 	return NULL;
 }
 
-void *rtl_shm_realloc(rtl_shm_ctl_block_t *scb, void *rmem, size_t newsize)
+/*
+ * rmem and newsize include the debug header, the block is tagged with tag
+ * and caller under the heap lock and the tagged pointer is returned.
+ */
+static void *heap_realloc(rtl_shm_ctl_block_t *scb, void *rmem, size_t newsize,
+		size_t tag, void *caller)
 {
 	size_t size;
 	size_t ptr, ptr2;
@@ -246,18 +874,11 @@ void *rtl_shm_realloc(rtl_shm_ctl_block_t *scb, void *rmem, size_t newsize)
 	if (newsize > scb->mem_size_aligned)
 		return NULL;
 
-	/* allocate a new memory block */
-	if (rmem == NULL)
-		return rtl_shm_malloc(scb, newsize);
-
-	rtl_sem_p(scb->heap_sem_id);
+	if (scb->mode == RTL_SHM_TLSF)
+		return tlsf_realloc(scb, rmem, newsize, tag, caller);
 
-	if ((uint8_t *)rmem < (uint8_t *)scb->heap_ptr ||
-		(uint8_t *)rmem >= (uint8_t *)scb->heap_end) {
-		/* illegal memory */
-		rtl_sem_v(scb->heap_sem_id);
-		return rmem;
-	}
+	if (heap_lock(scb) < 0)
+		return NULL;
 
 	mem = (struct rtl_heap_mem *)((uint8_t *)rmem - SIZEOF_STRUCT_MEM);
 
@@ -265,7 +886,8 @@ void *rtl_shm_realloc(rtl_shm_ctl_block_t *scb, void *rmem, size_t newsize)
 	size = mem->next - ptr - SIZEOF_STRUCT_MEM;
 	if (size == newsize) {
 		/* the size is the same as */
-		rtl_sem_v(scb->heap_sem_id);
+		rmem = debug_tag(rmem, tag, caller);
+		heap_unlock(scb);
 		return rmem;
 	}
 
@@ -285,28 +907,134 @@ void *rtl_shm_realloc(rtl_shm_ctl_block_t *scb, void *rmem, size_t newsize)
 
 		plug_holes(scb, mem2);
 
-		rtl_sem_v(scb->heap_sem_id);
+		rmem = debug_tag(rmem, tag, caller);
+		heap_unlock(scb);
 
 		return rmem;
 	}
-	rtl_sem_v(scb->heap_sem_id);
 
 	/* expand memory */
-	nmem = rtl_shm_malloc(scb, newsize);
+	nmem = debug_tag(heap_alloc(scb, newsize), tag, caller);
+	heap_unlock(scb);
 	if (nmem != NULL) {
-		memcpy(nmem, rmem, size < newsize ? size : newsize);
-		rtl_shm_free(scb, rmem);
+		memcpy(nmem, (uint8_t *)rmem + DEBUG_HDR,
+				(size < newsize ? size : newsize) - DEBUG_HDR);
+		heap_free(scb, rmem);
 	}
 
 	return nmem;
 }
 
+static void ff_free(rtl_shm_ctl_block_t *scb, void *rmem)
+{
+	struct rtl_heap_mem *mem;
+
+	/* Get the corresponding struct rtl_heap_mem ... */
+	mem = (struct rtl_heap_mem *)((uint8_t *)rmem - SIZEOF_STRUCT_MEM);
+
+	mem->used  = 0;
+	mem->magic = HEAP_MAGIC;
+
+	if (mem < scb->lfree) {
+		/* the newly freed struct is now the lowest */
+		scb->lfree = mem;
+	}
+
+	/* finally, see if prev or next are free also */
+	plug_holes(scb, mem);
+}
+
+/* with the heap locked */
+static void *heap_alloc(rtl_shm_ctl_block_t *scb, size_t size)
+{
+	if (scb->mode == RTL_SHM_TLSF)
+		return tlsf_malloc(scb, size);
+	return ff_malloc(scb, size);
+}
+
+static void heap_release(rtl_shm_ctl_block_t *scb, void *rmem)
+{
+	if (scb->mode == RTL_SHM_TLSF)
+		tlsf_free(scb, rmem);
+	else
+		ff_free(scb, rmem);
+}
+
+static size_t heap_usable(rtl_shm_ctl_block_t *scb, void *rmem)
+{
+	struct rtl_heap_mem *mem;
+
+	if (scb->mode == RTL_SHM_TLSF)
+		return tlsf_size(tlsf_block(scb, (uint8_t *)rmem - scb->heap_ptr - TLSF_HDR));
+	mem = (struct rtl_heap_mem *)((uint8_t *)rmem - SIZEOF_STRUCT_MEM);
+	return mem->next - ((uint8_t *)mem - scb->heap_ptr) - SIZEOF_STRUCT_MEM;
+}
+
+static void heap_free(rtl_shm_ctl_block_t *scb, void *rmem)
+{
+	if (rmem == NULL || !heap_contains(scb, rmem))
+		return;
+
+	/* protect the heap from concurrent access */
+	if (heap_lock(scb) < 0)
+		return;
+	heap_release(scb, rmem);
+	heap_unlock(scb);
+}
+
+#define CALLER					__builtin_return_address(0)
+
+static int shm_malloc_batch(rtl_shm_ctl_block_t *scb, size_t size, void **ptrs,
+		int n, void *caller)
+{
+	int i;
+
+	if (size == 0 || !ptrs || n <= 0)
+		return 0;
+
+	if (heap_lock(scb) < 0)
+		return 0;
+	for (i = 0; i < n; i++) {
+		ptrs[i] = debug_tag(heap_alloc(scb, size + DEBUG_HDR), size, caller);
+		if (!ptrs[i])
+			break;
+	}
+	heap_unlock(scb);
+
+	return i;
+}
+
+/* the tag is written under the heap lock, like for a batch */
+static void *shm_malloc(rtl_shm_ctl_block_t *scb, size_t size, void *caller)
+{
+	void *p;
+
+	if (shm_malloc_batch(scb, size, &p, 1, caller) != 1)
+		return NULL;
+	return p;
+}
+
+void *rtl_shm_malloc(rtl_shm_ctl_block_t *scb, size_t size)
+{
+	return shm_malloc(scb, size, CALLER);
+}
+
+void *rtl_shm_realloc(rtl_shm_ctl_block_t *scb, void *rmem, size_t newsize)
+{
+	if (rmem == NULL)
+		return shm_malloc(scb, newsize, CALLER);
+	if (!heap_contains(scb, debug_real(rmem)))
+		return rmem;
+	return heap_realloc(scb, debug_real(rmem), newsize + DEBUG_HDR,
+			newsize, CALLER);
+}
+
 void *rtl_shm_calloc(rtl_shm_ctl_block_t *scb, size_t count, size_t size)
 {
 	void *p;
 
 	/* allocate 'count' objects of size 'size' */
-	p = rtl_shm_malloc(scb, count * size);
+	p = shm_malloc(scb, count * size, CALLER);
 
 	/* zero the memory */
 	if (p)
@@ -316,32 +1044,352 @@ void *rtl_shm_calloc(rtl_shm_ctl_block_t *scb, size_t count, size_t size)
 }
 
 void rtl_shm_free(rtl_shm_ctl_block_t *scb, void *rmem)
+{
+	heap_free(scb, debug_real(rmem));
+}
+
+int rtl_shm_malloc_batch(rtl_shm_ctl_block_t *scb, size_t size, void **ptrs, int n)
+{
+	return shm_malloc_batch(scb, size, ptrs, n, CALLER);
+}
+
+void rtl_shm_free_batch(rtl_shm_ctl_block_t *scb, void **ptrs, int n)
+{
+	void *p;
+	int i;
+
+	if (heap_lock(scb) < 0)
+		return;
+	for (i = 0; i < n; i++) {
+		p = debug_real(ptrs[i]);
+		if (p == NULL || !heap_contains(scb, p))
+			continue;
+		heap_release(scb, p);
+	}
+	heap_unlock(scb);
+}
+
+size_t rtl_shm_usable_size(rtl_shm_ctl_block_t *scb, void *rmem)
+{
+	void *p = debug_real(rmem);
+
+	if (p == NULL || !heap_contains(scb, p))
+		return 0;
+
+	/* a used block's size only changes through its owner */
+	return heap_usable(scb, p) - DEBUG_HDR;
+}
+
+/* call fn for every block of the heap, with the heap locked */
+static void heap_blocks(rtl_shm_ctl_block_t *scb,
+		void (*fn)(void *data, size_t size, int used, void *args), void *args)
 {
 	struct rtl_heap_mem *mem;
+	struct tlsf_block *b;
+	size_t off, end;
+
+	if (scb->mode == RTL_SHM_TLSF) {
+		end = (uint8_t *)scb->heap_end - scb->heap_ptr;
+		for (off = tlsf_first(scb); off < end; off += TLSF_HDR + tlsf_size(b)) {
+			b = tlsf_block(scb, off);
+			fn(&scb->heap_ptr[off + TLSF_HDR], tlsf_size(b),
+					!(b->size & TLSF_BLOCK_FREE), args);
+		}
+		return;
+	}
 
-	if (rmem == NULL)
+	end = scb->mem_size_aligned + SIZEOF_STRUCT_MEM;
+	for (off = 0; off < end; off = mem->next) {
+		mem = (struct rtl_heap_mem *)&scb->heap_ptr[off];
+		if (mem->next <= off)
+			break;
+		fn((uint8_t *)mem + SIZEOF_STRUCT_MEM, mem->next - off - SIZEOF_STRUCT_MEM,
+				mem->used, args);
+	}
+}
+
+static void stats_block(void *data, size_t size, int used, void *args)
+{
+	struct rtl_shm_stats *st = (struct rtl_shm_stats *)args;
+
+	if (used) {
+		st->used_blocks++;
+		st->used_bytes += size;
+#ifdef RTL_SHM_DEBUG
+		if (debug_info(data)->caller == DEBUG_CACHED) {
+			st->cached_blocks++;
+			st->cached_bytes += size;
+		}
+#endif
 		return;
+	}
+	st->free_blocks++;
+	st->free_bytes += size;
+	if (size > st->largest_free)
+		st->largest_free = size;
+}
 
-	if ((uint8_t *)rmem < (uint8_t *)scb->heap_ptr ||
-		(uint8_t *)rmem >= (uint8_t *)scb->heap_end) {
+int rtl_shm_stats(rtl_shm_ctl_block_t *scb, struct rtl_shm_stats *st)
+{
+	if (!scb || !st) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return -1;
+	}
+
+	memset(st, 0, sizeof(*st));
+	st->heap_size = scb->mem_size_aligned;
+	if (heap_lock(scb) < 0)
+		return -1;
+	heap_blocks(scb, stats_block, st);
+	heap_unlock(scb);
+	if (st->free_bytes)
+		st->fragmentation = 1.0 - (double)st->largest_free / st->free_bytes;
+
+	return 0;
+}
+
+struct walk_args {
+	rtl_shm_walk_fn fn;
+	void *args;
+};
+
+static void walk_block(void *data, size_t size, int used, void *args)
+{
+	struct walk_args *wa = (struct walk_args *)args;
+
+	if (!used)
+		return;
+#ifdef RTL_SHM_DEBUG
+	if (debug_info(data)->caller == DEBUG_CACHED)
 		return;
+	wa->fn((uint8_t *)data + DEBUG_HDR, debug_info(data)->size,
+			debug_info(data)->caller, wa->args);
+#else
+	wa->fn(data, size, NULL, wa->args);
+#endif
+}
+
+int rtl_shm_walk(rtl_shm_ctl_block_t *scb, rtl_shm_walk_fn fn, void *args)
+{
+	struct walk_args wa;
+
+	if (!scb || !fn) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return -1;
 	}
 
-	/* Get the corresponding struct rtl_heap_mem ... */
-	mem = (struct rtl_heap_mem *)((uint8_t *)rmem - SIZEOF_STRUCT_MEM);
+	wa.fn = fn;
+	wa.args = args;
+	if (heap_lock(scb) < 0)
+		return -1;
+	heap_blocks(scb, walk_block, &wa);
+	heap_unlock(scb);
 
-	/* protect the heap from concurrent access */
-	rtl_sem_p(scb->heap_sem_id);
+	return 0;
+}
 
-	mem->used  = 0;
-	mem->magic = HEAP_MAGIC;
+struct dump_site {
+	void *caller;
+	size_t blocks;
+	size_t bytes;
+};
 
-	if (mem < scb->lfree) {
-		/* the newly freed struct is now the lowest */
-		scb->lfree = mem;
+struct dump_args {
+	struct dump_site *sites;
+	int nsites;
+	int size;
+};
+
+static void dump_block(void *rmem, size_t size, void *caller, void *args)
+{
+	struct dump_args *da = (struct dump_args *)args;
+	struct dump_site *sites;
+	int i;
+
+	for (i = 0; i < da->nsites; i++) {
+		if (da->sites[i].caller == caller)
+			break;
+	}
+	if (i == da->nsites) {
+		if (da->nsites == da->size) {
+			sites = realloc(da->sites, (da->size * 2 + 16) * sizeof(struct dump_site));
+			if (!sites)
+				return;
+			da->sites = sites;
+			da->size = da->size * 2 + 16;
+		}
+		da->sites[i].caller = caller;
+		da->sites[i].blocks = 0;
+		da->sites[i].bytes = 0;
+		da->nsites++;
 	}
+	da->sites[i].blocks++;
+	da->sites[i].bytes += size;
+}
 
-	/* finally, see if prev or next are free also */
-	plug_holes(scb, mem);
-	rtl_sem_v(scb->heap_sem_id);
+static int dump_cmp(const void *a, const void *b)
+{
+	const struct dump_site *sa = (const struct dump_site *)a;
+	const struct dump_site *sb = (const struct dump_site *)b;
+
+	if (sa->bytes == sb->bytes)
+		return 0;
+	return sa->bytes < sb->bytes ? 1 : -1;
+}
+
+void rtl_shm_dump(rtl_shm_ctl_block_t *scb, FILE *fp, int topn)
+{
+	struct rtl_shm_stats st;
+	struct dump_args da;
+	int i;
+
+	if (rtl_shm_stats(scb, &st) < 0)
+		return;
+
+	fprintf(fp, "heap %zu bytes, used %zu in %zu blocks, free %zu in %zu blocks\n",
+			st.heap_size, st.used_bytes, st.used_blocks, st.free_bytes, st.free_blocks);
+	fprintf(fp, "largest free %zu, fragmentation %.1f%%\n",
+			st.largest_free, st.fragmentation * 100);
+	if (st.cached_blocks)
+		fprintf(fp, "cached %zu in %zu blocks, not listed below\n",
+				st.cached_bytes, st.cached_blocks);
+
+	memset(&da, 0, sizeof(da));
+	rtl_shm_walk(scb, dump_block, &da);
+	qsort(da.sites, da.nsites, sizeof(struct dump_site), dump_cmp);
+	if (topn <= 0 || topn > da.nsites)
+		topn = da.nsites;
+	for (i = 0; i < topn; i++) {
+		fprintf(fp, "%18p %10zu blocks %14zu bytes\n", da.sites[i].caller,
+				da.sites[i].blocks, da.sites[i].bytes);
+	}
+	free(da.sites);
+}
+
+#define CACHE_CLASS_SHIFT		4
+#define CACHE_NCLASS			(RTL_SHM_CACHE_MAX >> CACHE_CLASS_SHIFT)
+#define CACHE_CAPACITY			64
+#define CACHE_BATCH				16
+
+struct cache_class {
+	int count;
+	void **objs;
+};
+
+struct rtl_shm_cache {
+	rtl_shm_ctl_block_t *scb;
+	int capacity;
+	int batch;
+	struct cache_class classes[CACHE_NCLASS];
+	void *objs[];
+};
+
+rtl_shm_cache_t *rtl_shm_cache_create(rtl_shm_ctl_block_t *scb, int capacity, int batch)
+{
+	rtl_shm_cache_t *cache;
+	int i;
+
+	if (!scb) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return NULL;
+	}
+	if (capacity <= 0)
+		capacity = CACHE_CAPACITY;
+	if (batch <= 0)
+		batch = CACHE_BATCH;
+	if (batch > capacity)
+		batch = capacity;
+
+	cache = calloc(1, sizeof(rtl_shm_cache_t) +
+			(size_t)CACHE_NCLASS * capacity * sizeof(void *));
+	if (!cache) {
+		fprintf(stderr, "calloc rtl_shm_cache_t failed!\n");
+		return NULL;
+	}
+	cache->scb = scb;
+	cache->capacity = capacity;
+	cache->batch = batch;
+	for (i = 0; i < CACHE_NCLASS; i++)
+		cache->classes[i].objs = &cache->objs[(size_t)i * capacity];
+
+	return cache;
+}
+
+void rtl_shm_cache_destroy(rtl_shm_cache_t *cache)
+{
+	if (!cache)
+		return;
+	rtl_shm_cache_flush(cache);
+	free(cache);
+}
+
+void *rtl_shm_cache_malloc(rtl_shm_cache_t *cache, size_t size)
+{
+	struct cache_class *cl;
+	size_t c;
+	void *p;
+
+	if (size == 0)
+		return NULL;
+	if (size > RTL_SHM_CACHE_MAX)
+		return shm_malloc(cache->scb, size, CALLER);
+
+	c = (size - 1) >> CACHE_CLASS_SHIFT;
+	cl = &cache->classes[c];
+	if (!cl->count) {
+		cl->count = shm_malloc_batch(cache->scb, (c + 1) << CACHE_CLASS_SHIFT,
+				cl->objs, cache->batch, DEBUG_CACHED);
+		if (!cl->count)
+			return NULL;
+	}
+	p = cl->objs[--cl->count];
+	return debug_retag(cache->scb, p, size, CALLER);
+}
+
+void rtl_shm_cache_free(rtl_shm_cache_t *cache, void *rmem)
+{
+	struct cache_class *cl;
+	size_t size, c;
+
+	if (rmem == NULL)
+		return;
+
+	size = rtl_shm_usable_size(cache->scb, rmem);
+	/* any block at least as large as a class can serve it */
+	c = (size >> CACHE_CLASS_SHIFT) - 1;
+	if (size < (1 << CACHE_CLASS_SHIFT) || c >= CACHE_NCLASS) {
+		rtl_shm_free(cache->scb, rmem);
+		return;
+	}
+
+	cl = &cache->classes[c];
+	if (cl->count == cache->capacity) {
+		/* return the oldest blocks, the recent ones are still hot */
+		rtl_shm_free_batch(cache->scb, cl->objs, cache->batch);
+		cl->count -= cache->batch;
+		memmove(cl->objs, cl->objs + cache->batch, cl->count * sizeof(void *));
+	}
+	cl->objs[cl->count++] = debug_retag(cache->scb, rmem, size, DEBUG_CACHED);
+}
+
+void rtl_shm_cache_flush(rtl_shm_cache_t *cache)
+{
+	struct cache_class *cl;
+	int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < CACHE_NCLASS; i++) {
+		cl = &cache->classes[i];
+		if (!cl->count)
+			continue;
+		rtl_shm_free_batch(cache->scb, cl->objs, cl->count);
+		cl->count = 0;
+	}
 }
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "rtl_spsc.h"
+
+#define CACHELINE		64
+
+/* record header, the length is kept 8 bytes aligned */
+#define REC_HDR			8
+#define REC_WRAP		UINT32_MAX
+#define REC_ALIGN(n)	(((n) + 7) & ~(size_t)7)
+
+struct rtl_spsc {
+	/* written by the producer */
+	size_t tail __attribute__ ((aligned(CACHELINE)));
+	size_t head_cache;
+	size_t reserved;		/* bytes taken by the pending reserve */
+	size_t reserve_skip;	/* bytes wasted by wrapping before it */
+	/* written by the consumer */
+	size_t head __attribute__ ((aligned(CACHELINE)));
+	size_t tail_cache;
+	size_t peeked;
+	/* read only */
+	char *buf __attribute__ ((aligned(CACHELINE)));
+	size_t mask;
+	size_t elem_size;
+};
+
+rtl_spsc_t *rtl_spsc_create(size_t nelems, size_t elem_size)
+{
+	rtl_spsc_t *q;
+	size_t n = 2;
+
+	if (!elem_size) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d invalid paraments\n", __func__, __LINE__);
+#endif
+		return NULL;
+	}
+	/* records need room for at least a header */
+	while (n < nelems || (elem_size == 1 && n < 2 * REC_HDR))
+		n <<= 1;
+	if (posix_memalign((void **)&q, CACHELINE, sizeof(rtl_spsc_t))) {
+		fprintf(stderr, "posix_memalign rtl_spsc_t failed!\n");
+		return NULL;
+	}
+	memset(q, 0, sizeof(rtl_spsc_t));
+	if (posix_memalign((void **)&q->buf, CACHELINE, n * elem_size)) {
+		fprintf(stderr, "posix_memalign spsc buffer failed!\n");
+		free(q);
+		return NULL;
+	}
+	q->mask = n - 1;
+	q->elem_size = elem_size;
+	return q;
+}
+
+void rtl_spsc_destroy(rtl_spsc_t *q)
+{
+	if (!q)
+		return;
+	free(q->buf);
+	free(q);
+}
+
+/* copy n elements between the ring at pos and p, minding the wrap */
+static void spsc_copy(rtl_spsc_t *q, size_t pos, void *p, size_t n, int in)
+{
+	size_t idx = pos & q->mask;
+	size_t first = q->mask + 1 - idx;
+	char *ring = q->buf + idx * q->elem_size;
+
+	if (first > n)
+		first = n;
+	if (in) {
+		memcpy(ring, p, first * q->elem_size);
+		memcpy(q->buf, (char *)p + first * q->elem_size, (n - first) * q->elem_size);
+	} else {
+		memcpy(p, ring, first * q->elem_size);
+		memcpy((char *)p + first * q->elem_size, q->buf, (n - first) * q->elem_size);
+	}
+}
+
+size_t rtl_spsc_push(rtl_spsc_t *q, const void *elems, size_t n)
+{
+	size_t tail = q->tail;
+	size_t room = q->mask + 1 - (tail - q->head_cache);
+
+	if (room < n) {
+		q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+		room = q->mask + 1 - (tail - q->head_cache);
+	}
+	if (n > room)
+		n = room;
+	if (!n)
+		return 0;
+	spsc_copy(q, tail, (void *)elems, n, 1);
+	__atomic_store_n(&q->tail, tail + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+size_t rtl_spsc_pop(rtl_spsc_t *q, void *elems, size_t n)
+{
+	size_t head = q->head;
+	size_t avail = q->tail_cache - head;
+
+	if (avail < n) {
+		q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+		avail = q->tail_cache - head;
+	}
+	if (n > avail)
+		n = avail;
+	if (!n)
+		return 0;
+	spsc_copy(q, head, elems, n, 0);
+	__atomic_store_n(&q->head, head + n, __ATOMIC_RELEASE);
+	return n;
+}
+
+size_t rtl_spsc_count(rtl_spsc_t *q)
+{
+	size_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+	size_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+	return tail - head;
+}
+
+void *rtl_spsc_reserve(rtl_spsc_t *q, size_t len)
+{
+	size_t size = q->mask + 1;
+	size_t tail = q->tail;
+	size_t idx = tail & q->mask;
+	size_t need = REC_ALIGN(REC_HDR + len);
+	size_t skip = 0;
+
+	if (len >= REC_WRAP)
+		return NULL;
+	/* records never wrap, the rest of the ring is skipped instead */
+	if (idx + need > size)
+		skip = size - idx;
+	if (skip + need > size - (tail - q->head_cache)) {
+		q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+		if (skip + need > size - (tail - q->head_cache))
+			return NULL;
+	}
+	if (skip) {
+		*(uint32_t *)(q->buf + idx) = REC_WRAP;
+		idx = 0;
+	}
+	q->reserved = need;
+	q->reserve_skip = skip;
+	return q->buf + idx + REC_HDR;
+}
+
+void rtl_spsc_commit(rtl_spsc_t *q, size_t len)
+{
+	size_t tail = q->tail + q->reserve_skip;
+	size_t need = REC_ALIGN(REC_HDR + len);
+
+	if (need > q->reserved) {
+#ifdef DEBUG
+		fprintf(stderr, "%s:%d commit exceeds the reservation\n", __func__, __LINE__);
+#endif
+		return;
+	}
+	*(uint32_t *)(q->buf + (tail & q->mask)) = len;
+	q->reserved = 0;
+	q->reserve_skip = 0;
+	__atomic_store_n(&q->tail, tail + need, __ATOMIC_RELEASE);
+}
+
+void *rtl_spsc_peek(rtl_spsc_t *q, size_t *len)
+{
+	size_t head = q->head;
+	uint32_t hdr;
+
+	if (head == q->tail_cache) {
+		q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+		if (head == q->tail_cache)
+			return NULL;
+	}
+	hdr = *(uint32_t *)(q->buf + (head & q->mask));
+	if (hdr == REC_WRAP) {
+		head += q->mask + 1 - (head & q->mask);
+		__atomic_store_n(&q->head, head, __ATOMIC_RELEASE);
+		hdr = *(uint32_t *)q->buf;
+	}
+	q->peeked = REC_ALIGN(REC_HDR + hdr);
+	*len = hdr;
+	return q->buf + (head & q->mask) + REC_HDR;
+}
+
+void rtl_spsc_release(rtl_spsc_t *q)
+{
+	__atomic_store_n(&q->head, q->head + q->peeked, __ATOMIC_RELEASE);
+	q->peeked = 0;
+}
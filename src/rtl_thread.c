@@ -1,7 +1,9 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sched.h>
 
 #include "rtl_thread.h"
 
@@ -16,39 +18,157 @@ static void *__thread_func(void *args)
 	return NULL;
 }
 
+void rtl_thread_attr_init(rtl_thread_attr_t *attr)
+{
+	memset(attr, 0, sizeof(rtl_thread_attr_t));
+	attr->policy = -1;
+}
+
+int rtl_thread_attr_set_cpu(rtl_thread_attr_t *attr, int cpu)
+{
+	if (!attr || cpu < 0 || cpu >= RTL_THREAD_MAX_CPUS) {
+		return -1;
+	}
+	attr->cpus[cpu / 64] |= (uint64_t)1 << (cpu % 64);
+	return 0;
+}
+
+int rtl_thread_attr_set_node(rtl_thread_attr_t *attr, int node)
+{
+	char path[64], list[1024];
+	char *p, *end;
+	long lo, hi;
+	FILE *fp;
+
+	if (!attr || node < 0) {
+		return -1;
+	}
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	if (!(fp = fopen(path, "r"))) {
+		fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (!fgets(list, sizeof(list), fp)) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	/* e.g. "0-7,16-23" */
+	for (p = list; *p && *p != '\n'; p = end) {
+		lo = strtol(p, &end, 10);
+		if (end == p) {
+			return -1;
+		}
+		hi = lo;
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtol(p, &end, 10);
+		}
+		while (lo <= hi) {
+			rtl_thread_attr_set_cpu(attr, lo++);
+		}
+		if (*end == ',') {
+			end++;
+		}
+	}
+	return 0;
+}
+
+static int thread_attr_apply(pthread_attr_t *pattr, const rtl_thread_attr_t *attr)
+{
+	struct sched_param param;
+	cpu_set_t set;
+	int i, ncpus = 0;
+	int ret;
+
+	if (attr->stack_size && (ret = pthread_attr_setstacksize(pattr, attr->stack_size))) {
+		fprintf(stderr, "pthread_attr_setstacksize failed: %s\n", strerror(ret));
+		return -1;
+	}
+	if (attr->guard_size && (ret = pthread_attr_setguardsize(pattr, attr->guard_size))) {
+		fprintf(stderr, "pthread_attr_setguardsize failed: %s\n", strerror(ret));
+		return -1;
+	}
+	if (attr->policy >= 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = attr->priority;
+		pthread_attr_setinheritsched(pattr, PTHREAD_EXPLICIT_SCHED);
+		if ((ret = pthread_attr_setschedpolicy(pattr, attr->policy)) ||
+			(ret = pthread_attr_setschedparam(pattr, &param))) {
+			fprintf(stderr, "pthread scheduling attributes failed: %s\n", strerror(ret));
+			return -1;
+		}
+	}
+	CPU_ZERO(&set);
+	for (i = 0; i < RTL_THREAD_MAX_CPUS && i < CPU_SETSIZE; i++) {
+		if (attr->cpus[i / 64] & ((uint64_t)1 << (i % 64))) {
+			CPU_SET(i, &set);
+			ncpus++;
+		}
+	}
+	if (ncpus && (ret = pthread_attr_setaffinity_np(pattr, sizeof(set), &set))) {
+		fprintf(stderr, "pthread_attr_setaffinity_np failed: %s\n", strerror(ret));
+		return -1;
+	}
+	return 0;
+}
+
 rtl_thread_t *rtl_thread_create(void *(*func)(rtl_thread_t *),
 		const char *name, void *args)
 {
+	return rtl_thread_create_attr(func, name, args, NULL);
+}
+
+rtl_thread_t *rtl_thread_create_attr(void *(*func)(rtl_thread_t *),
+		const char *name, void *args, const rtl_thread_attr_t *attr)
+{
+	pthread_attr_t pattr;
+	char kname[16];
+
 	rtl_thread_t *t = calloc(1, sizeof(rtl_thread_t));
 	if (!t) {
 		fprintf(stderr, "calloc rtl_thread_t failed(%d): %s\n", errno, strerror(errno));
 		return NULL;
 	}
-	if (!(t->spin = rtl_spin_lock_init())) {
-		fprintf(stderr, "rtl_spin_lock_init failed\n");
-		goto err;
-	}
-	if (!(t->mutex = rtl_mutex_lock_init())) {
-		fprintf(stderr, "rtl_mutex_lock_init failed\n");
-		goto err;
-	}
-	if (!(t->cond = rtl_mutex_cond_init())) {
-		fprintf(stderr, "rtl_mutex_cond_init failed\n");
-		goto err;
-	}
-	if (!(t->sem = rtl_sem_lock_init())) {
-		fprintf(stderr, "rtl_sem_lock_init failed\n");
-		goto err;
+	t->lazy_sync = attr ? attr->lazy_sync : 0;
+	if (!t->lazy_sync) {
+		if (!(t->spin = rtl_spin_lock_init())) {
+			fprintf(stderr, "rtl_spin_lock_init failed\n");
+			goto err;
+		}
+		if (!(t->mutex = rtl_mutex_lock_init())) {
+			fprintf(stderr, "rtl_mutex_lock_init failed\n");
+			goto err;
+		}
+		if (!(t->cond = rtl_mutex_cond_init())) {
+			fprintf(stderr, "rtl_mutex_cond_init failed\n");
+			goto err;
+		}
+		if (!(t->sem = rtl_sem_lock_init())) {
+			fprintf(stderr, "rtl_sem_lock_init failed\n");
+			goto err;
+		}
 	}
 
 	strncpy(t->name, name, sizeof(t->name) - 1);
 	t->args = args;
 	t->func = func;
-	int ret = pthread_create(&t->tid, NULL, __thread_func, t);
+	pthread_attr_init(&pattr);
+	if (attr && thread_attr_apply(&pattr, attr) < 0) {
+		pthread_attr_destroy(&pattr);
+		goto err;
+	}
+	int ret = pthread_create(&t->tid, &pattr, __thread_func, t);
+	pthread_attr_destroy(&pattr);
 	if (ret != 0) {
 		fprintf(stderr, "pthread_create failed(%d): %s\n", ret, strerror(ret));
 		goto err;
 	}
+	/* the kernel keeps 15 characters */
+	memcpy(kname, t->name, sizeof(kname) - 1);
+	kname[sizeof(kname) - 1] = '\0';
+	pthread_setname_np(t->tid, kname);
 	return t;
 
 err:
@@ -67,17 +187,46 @@ void rtl_thread_destroy(rtl_thread_t *t)
 	if (!t) {
 		return;
 	}
+	/* the thread may still create lazy objects until it is joined */
+	pthread_join(t->tid, NULL);
 	if (t->spin) rtl_spin_lock_deinit(t->spin);
 	if (t->sem) rtl_sem_lock_deinit(t->sem);
 	if (t->mutex) rtl_mutex_lock_deinit(t->mutex);
 	if (t->cond) rtl_mutex_cond_deinit(t->cond);
-	pthread_join(t->tid, NULL);
 	free(t);
 }
 
+/*
+ * return the sync object in field, creating it on first use for lazy
+ * threads. racing creators publish with a CAS and the loser frees its copy.
+ */
+#define THREAD_SYNC_GET(field, type, init, deinit)							\
+static type *thread_##field(rtl_thread_t *t)								\
+{																			\
+	type *obj = __atomic_load_n(&t->field, __ATOMIC_ACQUIRE);				\
+	type *expect = NULL;													\
+	if (obj || !t->lazy_sync) {												\
+		return obj;															\
+	}																		\
+	if (!(obj = init())) {													\
+		return NULL;														\
+	}																		\
+	if (!__atomic_compare_exchange_n(&t->field, &expect, obj, 0,			\
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {						\
+		deinit(obj);														\
+		obj = expect;														\
+	}																		\
+	return obj;																\
+}
+
+THREAD_SYNC_GET(spin, rtl_spin_lock_t, rtl_spin_lock_init, rtl_spin_lock_deinit)
+THREAD_SYNC_GET(mutex, rtl_mutex_lock_t, rtl_mutex_lock_init, rtl_mutex_lock_deinit)
+THREAD_SYNC_GET(cond, rtl_mutex_cond_t, rtl_mutex_cond_init, rtl_mutex_cond_deinit)
+THREAD_SYNC_GET(sem, rtl_sem_lock_t, rtl_sem_lock_init, rtl_sem_lock_deinit)
+
 int rtl_thread_spin_lock(rtl_thread_t *t)
 {
-	if (!t || !t->spin) {
+	if (!t || !thread_spin(t)) {
 		return -1;
 	}
 	return rtl_spin_lock(t->spin);
@@ -85,7 +234,7 @@ int rtl_thread_spin_lock(rtl_thread_t *t)
 
 int rtl_thread_spin_unlock(rtl_thread_t *t)
 {
-	if (!t || !t->spin) {
+	if (!t || !thread_spin(t)) {
 		return -1;
 	}
 	return rtl_spin_unlock(t->spin);
@@ -93,7 +242,7 @@ int rtl_thread_spin_unlock(rtl_thread_t *t)
 
 int rtl_thread_mutex_lock(rtl_thread_t *t)
 {
-	if (!t || !t->mutex) {
+	if (!t || !thread_mutex(t)) {
 		return -1;
 	}
 	return rtl_mutex_lock(t->mutex);
@@ -101,7 +250,7 @@ int rtl_thread_mutex_lock(rtl_thread_t *t)
 
 int rtl_thread_mutex_unlock(rtl_thread_t *t)
 {
-	if (!t || !t->mutex) {
+	if (!t || !thread_mutex(t)) {
 		return -1;
 	}
 	return rtl_mutex_unlock(t->mutex);
@@ -109,7 +258,7 @@ int rtl_thread_mutex_unlock(rtl_thread_t *t)
 
 int rtl_thread_cond_wait(rtl_thread_t *t, int64_t ms)
 {
-	if (!t || !t->mutex || !t->cond) {
+	if (!t || !thread_mutex(t) || !thread_cond(t)) {
 		return -1;
 	}
 	return rtl_mutex_cond_wait(t->mutex, t->cond, ms);
@@ -117,7 +266,7 @@ int rtl_thread_cond_wait(rtl_thread_t *t, int64_t ms)
 
 int rtl_thread_cond_signal(rtl_thread_t *t)
 {
-	if (!t || !t->cond) {
+	if (!t || !thread_cond(t)) {
 		return -1;
 	}
 	rtl_mutex_cond_signal(t->cond);
@@ -126,7 +275,7 @@ int rtl_thread_cond_signal(rtl_thread_t *t)
 
 int rtl_thread_cond_signal_all(rtl_thread_t *t)
 {
-	if (!t || !t->cond) {
+	if (!t || !thread_cond(t)) {
 		return -1;
 	}
 	rtl_mutex_cond_signal_all(t->cond);
@@ -135,7 +284,7 @@ int rtl_thread_cond_signal_all(rtl_thread_t *t)
 
 int rtl_thread_sem_wait(rtl_thread_t *t, int64_t ms)
 {
-	if (!t || !t->sem) {
+	if (!t || !thread_sem(t)) {
 		return -1;
 	}
 	return rtl_sem_lock_wait(t->sem, ms);
@@ -143,7 +292,7 @@ int rtl_thread_sem_wait(rtl_thread_t *t, int64_t ms)
 
 int rtl_thread_sem_signal(rtl_thread_t *t)
 {
-	if (!t || !t->sem) {
+	if (!t || !thread_sem(t)) {
 		return -1;
 	}
 	return rtl_sem_lock_signal(t->sem);
@@ -0,0 +1,388 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "rtl_event.h"
+
+#define URING_SQ_ENTRIES		256
+#define URING_CQ_ENTRIES		4096
+#define URING_REMOVE_DATA		UINT64_MAX
+
+/*
+ * io_uring has no persistent registration, every rtl_event is a one-shot
+ * IORING_OP_POLL_ADD that is re-armed after its callbacks ran. adds,
+ * removes and re-arms are only queued in the SQ ring and are submitted
+ * together with the wait for completions, so one loop iteration costs a
+ * single io_uring_enter no matter how many events changed.
+ *
+ * the user_data of a poll is (generation << 32 | fd), the generation is
+ * bumped on every del so completions of removed events are dropped even
+ * after the rtl_event itself has been freed. a poll completing with an
+ * error deletes its event, rtl_event_add registers it again.
+ */
+struct uring_reg {
+	struct rtl_event *e;
+	uint32_t gen;
+};
+
+struct uring_ctx {
+	int ringfd;
+	unsigned sq_entries;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned sq_pending;
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_ring_size;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	struct uring_reg *regs;
+	int nregs;
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+		unsigned flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+			arg, argsz);
+}
+
+static void uring_unmap(struct uring_ctx *uc)
+{
+	if (uc->sqes && uc->sqes != MAP_FAILED)
+		munmap(uc->sqes, uc->sqes_size);
+	if (uc->cq_ring && uc->cq_ring != MAP_FAILED && uc->cq_ring != uc->sq_ring)
+		munmap(uc->cq_ring, uc->cq_ring_size);
+	if (uc->sq_ring && uc->sq_ring != MAP_FAILED)
+		munmap(uc->sq_ring, uc->sq_ring_size);
+}
+
+static void *uring_init(void)
+{
+	struct uring_ctx *uc;
+	struct io_uring_params p;
+
+	uc = calloc(1, sizeof(struct uring_ctx));
+	if (!uc) {
+		perror("calloc");
+		return NULL;
+	}
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = URING_CQ_ENTRIES;
+	uc->ringfd = uring_setup(URING_SQ_ENTRIES, &p);
+	if (uc->ringfd < 0) {
+		perror("io_uring_setup");
+		free(uc);
+		return NULL;
+	}
+	/* the wait timeout is passed to io_uring_enter directly */
+	if (!(p.features & IORING_FEAT_EXT_ARG)) {
+		fprintf(stderr, "io_uring: kernel lacks IORING_FEAT_EXT_ARG\n");
+		goto err;
+	}
+
+	uc->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	uc->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (uc->cq_ring_size > uc->sq_ring_size)
+			uc->sq_ring_size = uc->cq_ring_size;
+		uc->cq_ring_size = uc->sq_ring_size;
+	}
+	uc->sq_ring = mmap(NULL, uc->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, uc->ringfd, IORING_OFF_SQ_RING);
+	if (uc->sq_ring == MAP_FAILED) {
+		perror("mmap");
+		goto err;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		uc->cq_ring = uc->sq_ring;
+	} else {
+		uc->cq_ring = mmap(NULL, uc->cq_ring_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, uc->ringfd, IORING_OFF_CQ_RING);
+		if (uc->cq_ring == MAP_FAILED) {
+			perror("mmap");
+			goto err;
+		}
+	}
+	uc->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	uc->sqes = mmap(NULL, uc->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, uc->ringfd, IORING_OFF_SQES);
+	if (uc->sqes == MAP_FAILED) {
+		perror("mmap");
+		goto err;
+	}
+
+	uc->sq_entries = p.sq_entries;
+	uc->sq_head = (unsigned *)((char *)uc->sq_ring + p.sq_off.head);
+	uc->sq_tail = (unsigned *)((char *)uc->sq_ring + p.sq_off.tail);
+	uc->sq_mask = (unsigned *)((char *)uc->sq_ring + p.sq_off.ring_mask);
+	uc->sq_array = (unsigned *)((char *)uc->sq_ring + p.sq_off.array);
+	uc->cq_head = (unsigned *)((char *)uc->cq_ring + p.cq_off.head);
+	uc->cq_tail = (unsigned *)((char *)uc->cq_ring + p.cq_off.tail);
+	uc->cq_mask = (unsigned *)((char *)uc->cq_ring + p.cq_off.ring_mask);
+	uc->cqes = (struct io_uring_cqe *)((char *)uc->cq_ring + p.cq_off.cqes);
+	return uc;
+
+err:
+	uring_unmap(uc);
+	close(uc->ringfd);
+	free(uc);
+	return NULL;
+}
+
+static void uring_deinit(void *ctx)
+{
+	struct uring_ctx *uc = (struct uring_ctx *)ctx;
+	if (!uc)
+		return;
+
+	uring_unmap(uc);
+	close(uc->ringfd);
+	free(uc->regs);
+	free(uc);
+}
+
+/* push the queued sqes to the kernel without waiting */
+static int uring_flush(struct uring_ctx *uc)
+{
+	int ret;
+
+	while (uc->sq_pending) {
+		ret = uring_enter(uc->ringfd, uc->sq_pending, 0, 0, NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("io_uring_enter");
+			return -1;
+		}
+		uc->sq_pending -= ret;
+	}
+	return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct uring_ctx *uc)
+{
+	unsigned head, tail;
+	struct io_uring_sqe *sqe;
+
+	tail = *uc->sq_tail;
+	head = __atomic_load_n(uc->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= uc->sq_entries) {
+		if (uring_flush(uc) < 0)
+			return NULL;
+		head = __atomic_load_n(uc->sq_head, __ATOMIC_ACQUIRE);
+	}
+	sqe = &uc->sqes[tail & *uc->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	uc->sq_array[tail & *uc->sq_mask] = tail & *uc->sq_mask;
+	__atomic_store_n(uc->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	uc->sq_pending++;
+	return sqe;
+}
+
+static uint64_t uring_data(int fd, uint32_t gen)
+{
+	return ((uint64_t)gen << 32) | (uint32_t)fd;
+}
+
+static int uring_poll_add(struct uring_ctx *uc, struct rtl_event *e)
+{
+	struct io_uring_sqe *sqe;
+	unsigned events = 0;
+
+	if (e->flags & EVENT_READ)
+		events |= POLLIN;
+	if (e->flags & EVENT_WRITE)
+		events |= POLLOUT;
+	if (e->flags & EVENT_ERROR)
+		events |= POLLERR;
+	if (e->flags & EVENT_CLOSED)
+		events |= POLLRDHUP;
+
+	sqe = uring_get_sqe(uc);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = e->evfd;
+	sqe->poll32_events = events;
+	sqe->user_data = uring_data(e->evfd, uc->regs[e->evfd].gen);
+	return 0;
+}
+
+static int uring_add(struct rtl_event_base *eb, struct rtl_event *e)
+{
+	struct uring_ctx *uc = (struct uring_ctx *)eb->ctx;
+
+	if (e->evfd < 0)
+		return -1;
+	if (e->evfd >= uc->nregs) {
+		int n = uc->nregs ? uc->nregs : 64;
+		struct uring_reg *regs;
+
+		while (n <= e->evfd)
+			n <<= 1;
+		regs = realloc(uc->regs, n * sizeof(struct uring_reg));
+		if (!regs) {
+			perror("realloc");
+			return -1;
+		}
+		memset(regs + uc->nregs, 0, (n - uc->nregs) * sizeof(struct uring_reg));
+		uc->regs = regs;
+		uc->nregs = n;
+	}
+	if (uc->regs[e->evfd].e) {
+		errno = EEXIST;
+		return -1;
+	}
+	uc->regs[e->evfd].e = e;
+	return uring_poll_add(uc, e);
+}
+
+static int uring_poll_remove(struct uring_ctx *uc, struct rtl_event *e)
+{
+	struct uring_reg *reg;
+	struct io_uring_sqe *sqe;
+
+	if (e->evfd < 0 || e->evfd >= uc->nregs || uc->regs[e->evfd].e != e) {
+		errno = ENOENT;
+		return -1;
+	}
+	reg = &uc->regs[e->evfd];
+	sqe = uring_get_sqe(uc);
+	if (!sqe)
+		return -1;
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = uring_data(e->evfd, reg->gen);
+	sqe->user_data = URING_REMOVE_DATA;
+	reg->gen++;
+	return 0;
+}
+
+static int uring_del(struct rtl_event_base *eb, struct rtl_event *e)
+{
+	struct uring_ctx *uc = (struct uring_ctx *)eb->ctx;
+
+	if (uring_poll_remove(uc, e) < 0)
+		return -1;
+	uc->regs[e->evfd].e = NULL;
+	return 0;
+}
+
+/*
+ * polls are one-shot anyway, EVENT_ET has no meaning here and
+ * EVENT_EXCLUSIVE is ignored. the remove and the new poll are queued
+ * together and cost no extra syscall.
+ */
+static int uring_mod(struct rtl_event_base *eb, struct rtl_event *e)
+{
+	struct uring_ctx *uc = (struct uring_ctx *)eb->ctx;
+
+	if (uring_poll_remove(uc, e) < 0)
+		return -1;
+	return uring_poll_add(uc, e);
+}
+
+static int uring_dispatch(struct rtl_event_base *eb, struct timeval *tv)
+{
+	struct uring_ctx *uc = (struct uring_ctx *)eb->ctx;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned head, tail;
+	int ret, what, n;
+
+	memset(&arg, 0, sizeof(arg));
+	if (tv != NULL) {
+		ts.tv_sec = tv->tv_sec;
+		ts.tv_nsec = tv->tv_usec * 1000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+	}
+	ret = uring_enter(uc->ringfd, uc->sq_pending, 1,
+			IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	if (ret < 0) {
+		if (errno != EINTR && errno != ETIME && errno != EBUSY) {
+			perror("io_uring_enter");
+			return -1;
+		}
+	} else {
+		uc->sq_pending -= ret;
+	}
+
+	head = *uc->cq_head;
+	tail = __atomic_load_n(uc->cq_tail, __ATOMIC_ACQUIRE);
+	n = tail - head;
+	rtl_event_base_ready(eb, n);
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &uc->cqes[head & *uc->cq_mask];
+		int fd = (int)(cqe->user_data & 0xffffffff);
+		uint32_t gen = cqe->user_data >> 32;
+		int res = cqe->res;
+		struct rtl_event *e;
+
+		if (cqe->user_data == URING_REMOVE_DATA)
+			continue;
+		if (fd >= uc->nregs || uc->regs[fd].gen != gen || !uc->regs[fd].e)
+			continue;
+		e = uc->regs[fd].e;
+
+		if (res < 0) {
+			/*
+			 * the poll failed (bad fd), a re-arm would fail the same way,
+			 * so the event is dropped before its error callback runs.
+			 */
+			uc->regs[fd].e = NULL;
+			uc->regs[fd].gen++;
+			e->base = NULL;
+			rtl_event_base_active(eb, e, EVENT_ERROR);
+			continue;
+		}
+		what = 0;
+		if (res & POLLIN)
+			what |= EVENT_READ;
+		if (res & POLLOUT)
+			what |= EVENT_WRITE;
+		if (res & POLLERR)
+			what |= EVENT_ERROR;
+		/* as in epoll, a hangup re-armed without a callback would spin */
+		if (res & (POLLHUP | POLLRDHUP))
+			what |= EVENT_READ | EVENT_ERROR;
+		rtl_event_base_active(eb, e, what);
+		/* re-arm unless one-shot or a callback removed or modified it */
+		if (uc->regs[fd].gen == gen && uc->regs[fd].e == e &&
+			(e->flags & EVENT_PERSIST))
+			uring_poll_add(uc, e);
+	}
+	__atomic_store_n(uc->cq_head, head, __ATOMIC_RELEASE);
+	return n;
+}
+
+const struct rtl_event_ops rtl_uring_ops = {
+	.name     = "io_uring",
+	.init     = uring_init,
+	.deinit   = uring_deinit,
+	.add      = uring_add,
+	.del      = uring_del,
+	.mod      = uring_mod,
+	.dispatch = uring_dispatch,
+};
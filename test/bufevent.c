@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <rtl_event.h>
+#include <rtl_bufevent.h>
+
+/* two bufevents relaying to each other, like both sides of a proxy */
+struct proxy {
+	struct rtl_bufevent *bev[2];
+	int reads;
+};
+
+static void on_read(struct rtl_bufevent *bev, void *args)
+{
+	struct proxy *p = (struct proxy *)args;
+
+	p->reads++;
+	printf("on_read %s side\n", bev == p->bev[0] ? "client" : "server");
+	/* closing one side closes its peer too, while both are ready */
+	rtl_bufevent_destroy(p->bev[0]);
+	rtl_bufevent_destroy(p->bev[1]);
+	p->bev[0] = p->bev[1] = NULL;
+}
+
+static int peer_destroy(const char *backend)
+{
+	struct rtl_event_base *eb;
+	struct proxy p = { { NULL, NULL }, 0 };
+	int sv[2][2];
+	int i;
+
+	eb = rtl_event_base_create_backend(backend);
+	if (!eb) {
+		printf("%s: rtl_event_base_create_backend failed!\n", backend);
+		return 0;
+	}
+	for (i = 0; i < 2; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv[i]) < 0) {
+			perror("socketpair");
+			return -1;
+		}
+		p.bev[i] = rtl_bufevent_create(eb, sv[i][0], on_read, NULL, NULL, &p);
+		if (!p.bev[i]) {
+			printf("rtl_bufevent_create failed!\n");
+			return -1;
+		}
+	}
+	/* make both sides readable so they land in the same ready batch */
+	for (i = 0; i < 2; i++) {
+		if (write(sv[i][1], "ping", 4) != 4) {
+			perror("write");
+			return -1;
+		}
+	}
+	while (p.bev[0])
+		rtl_event_base_wait(eb);
+	/* a few more rounds for stale completions of the freed events */
+	for (i = 0; i < 3; i++) {
+		rtl_event_base_signal(eb);
+		rtl_event_base_wait(eb);
+	}
+	rtl_event_base_destroy(eb);
+	for (i = 0; i < 2; i++)
+		close(sv[i][1]);
+
+	printf("%s: %d read callback(s)\n", backend, p.reads);
+	return p.reads == 1 ? 0 : -1;
+}
+
+int main()
+{
+	if (peer_destroy("epoll") < 0 || peer_destroy("io_uring") < 0) {
+		printf("peer destroy failed!\n");
+		return -1;
+	}
+	printf("peer destroy ok\n");
+
+	return 0;
+}
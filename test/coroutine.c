@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <rtl_coroutine.h>
+
+#define NUM_CLIENTS	10
+
+static struct rtl_event_base *eb;
+static int listen_fd;
+static uint16_t listen_port;
+static int done;
+
+void echo(void *args)
+{
+	int fd = (int)(long)args;
+	char buf[1024];
+	int n;
+
+	while ((n = rtl_co_recv(fd, buf, sizeof(buf))) > 0)
+		rtl_co_sendn(fd, buf, n);
+	rtl_co_close(fd);
+}
+
+void server(void *args)
+{
+	int i, fd;
+
+	for (i = 0; i < NUM_CLIENTS; i++) {
+		fd = rtl_co_accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			perror("accept");
+			break;
+		}
+		rtl_coroutine_create(eb, echo, (void *)(long)fd, 0);
+	}
+	rtl_co_close(listen_fd);
+}
+
+void client(void *args)
+{
+	struct sockaddr_in si;
+	char msg[64], buf[64];
+	int fd;
+
+	memset(&si, 0, sizeof(si));
+	si.sin_family = AF_INET;
+	si.sin_port = htons(listen_port);
+	si.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (rtl_co_connect(fd, (struct sockaddr *)&si, sizeof(si)) < 0) {
+		perror("connect");
+		rtl_co_close(fd);
+		return;
+	}
+
+	snprintf(msg, sizeof(msg), "hello from client %ld", (long)args);
+	rtl_co_sendn(fd, msg, strlen(msg) + 1);
+	if (rtl_co_recvn(fd, buf, strlen(msg) + 1) > 0)
+		printf("%s\n", buf);
+
+	/* nothing else comes, so this times out */
+	if (rtl_co_wait(fd, EVENT_READ, 100) < 0)
+		printf("client %ld: wait timeout\n", (long)args);
+
+	rtl_co_close(fd);
+	if (++done == NUM_CLIENTS)
+		rtl_event_base_loop_break(eb);
+}
+
+int main()
+{
+	struct sockaddr_in si;
+	socklen_t len = sizeof(si);
+	long i;
+
+	eb = rtl_event_base_create();
+	if (!eb)
+		return -1;
+
+	memset(&si, 0, sizeof(si));
+	si.sin_family = AF_INET;
+	si.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (bind(listen_fd, (struct sockaddr *)&si, sizeof(si)) < 0 ||
+		listen(listen_fd, NUM_CLIENTS) < 0 ||
+		getsockname(listen_fd, (struct sockaddr *)&si, &len) < 0) {
+		perror("listen");
+		return -1;
+	}
+	listen_port = ntohs(si.sin_port);
+
+	rtl_coroutine_create(eb, server, NULL, 0);
+	for (i = 0; i < NUM_CLIENTS; i++)
+		rtl_coroutine_create(eb, client, (void *)i, 0);
+
+	rtl_event_base_loop(eb);
+	printf("%d clients done\n", done);
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+
+#include <rtl_future.h>
+
+#define NUM_PARTS	8
+
+static long parts[NUM_PARTS];
+
+void *count_part(void *args)
+{
+	long n = (long)args;
+	long i, sum = 0;
+
+	for (i = n * 1000; i < (n + 1) * 1000; i++)
+		sum += i;
+	parts[n] = sum;
+
+	return NULL;
+}
+
+void *merge(void *args)
+{
+	long i, sum = 0;
+
+	/* every part has completed when a dependent task runs */
+	for (i = 0; i < NUM_PARTS; i++)
+		sum += parts[i];
+
+	return (void *)sum;
+}
+
+void merged(rtl_future_t *f, void *args)
+{
+	printf("merged = %ld\n", (long)rtl_future_get(f));
+}
+
+int main()
+{
+	rtl_future_t *deps[NUM_PARTS];
+	rtl_future_t *f;
+	rtl_pool_t *pool;
+	long i;
+
+	pool = rtl_pool_create(0);
+	if (!pool)
+		return -1;
+
+	for (i = 0; i < NUM_PARTS; i++)
+		deps[i] = rtl_future_submit(pool, count_part, (void *)i);
+
+	f = rtl_future_submit_after(pool, merge, NULL, deps, NUM_PARTS);
+	for (i = 0; i < NUM_PARTS; i++)
+		rtl_future_release(deps[i]);
+
+	rtl_future_then(f, NULL, merged, NULL);
+	printf("sum = %ld, expected %ld\n", (long)rtl_future_get(f),
+			(long)NUM_PARTS * 1000 * (NUM_PARTS * 1000 - 1) / 2);
+
+	rtl_future_release(f);
+	rtl_pool_destroy(pool);
+
+	return 0;
+}
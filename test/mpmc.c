@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <rtl_mpmc.h>
+#include <rtl_lock.h>
+#include <rtl_thread.h>
+
+#define NUM_ITEMS	100000
+#define QUEUE_SIZE	1024
+#define BENCH_ITEMS	400000
+#define MAX_THREADS	8
+
+static rtl_mpmc_t *q;
+
+/* the baseline: a ring under one mutex, with a condvar for each side */
+struct lock_queue {
+	rtl_mutex_lock_t *lock;
+	rtl_mutex_cond_t *not_empty;
+	rtl_mutex_cond_t *not_full;
+	void *items[QUEUE_SIZE];
+	size_t head;
+	size_t count;
+};
+
+static struct lock_queue lq;
+
+static void lq_push(void *data)
+{
+	rtl_mutex_lock(lq.lock);
+	while (lq.count == QUEUE_SIZE)
+		rtl_mutex_cond_wait(lq.lock, lq.not_full, 0);
+	lq.items[(lq.head + lq.count++) % QUEUE_SIZE] = data;
+	rtl_mutex_cond_signal(lq.not_empty);
+	rtl_mutex_unlock(lq.lock);
+}
+
+static void *lq_pop(void)
+{
+	void *data;
+
+	rtl_mutex_lock(lq.lock);
+	while (lq.count == 0)
+		rtl_mutex_cond_wait(lq.lock, lq.not_empty, 0);
+	data = lq.items[lq.head];
+	lq.head = (lq.head + 1) % QUEUE_SIZE;
+	lq.count--;
+	rtl_mutex_cond_signal(lq.not_full);
+	rtl_mutex_unlock(lq.lock);
+	return data;
+}
+
+struct bench_args {
+	int locked;
+	long n;
+};
+
+void *producer(rtl_thread_t *t)
+{
+	long i;
+
+	for (i = 1; i <= NUM_ITEMS; i++)
+		rtl_mpmc_push(q, (void *)i, -1);
+
+	return NULL;
+}
+
+void *consumer(rtl_thread_t *t)
+{
+	long *sum = (long *)t->args;
+	void *data;
+	long i;
+
+	for (i = 0; i < NUM_ITEMS; i++) {
+		if (rtl_mpmc_pop(q, &data, 1000) < 0) {
+			printf("%s: pop timeout\n", t->name);
+			break;
+		}
+		*sum += (long)data;
+	}
+
+	return NULL;
+}
+
+void *bench_producer(rtl_thread_t *t)
+{
+	struct bench_args *args = (struct bench_args *)t->args;
+	long i;
+
+	for (i = 1; i <= args->n; i++) {
+		if (args->locked)
+			lq_push((void *)i);
+		else
+			rtl_mpmc_push(q, (void *)i, -1);
+	}
+
+	return NULL;
+}
+
+void *bench_consumer(rtl_thread_t *t)
+{
+	struct bench_args *args = (struct bench_args *)t->args;
+	void *data;
+	long i;
+
+	for (i = 0; i < args->n; i++) {
+		if (args->locked)
+			data = lq_pop();
+		else
+			rtl_mpmc_pop(q, &data, -1);
+	}
+
+	return NULL;
+}
+
+/* items per second through either queue with np producers and nc consumers */
+static double bench(int locked, int np, int nc)
+{
+	rtl_thread_t *threads[2 * MAX_THREADS];
+	struct bench_args pargs, cargs;
+	struct timespec start, end;
+	int i;
+
+	pargs.locked = cargs.locked = locked;
+	pargs.n = BENCH_ITEMS / np;
+	cargs.n = BENCH_ITEMS / nc;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nc; i++)
+		threads[i] = rtl_thread_create(bench_consumer, "bench-c", &cargs);
+	for (i = 0; i < np; i++)
+		threads[nc + i] = rtl_thread_create(bench_producer, "bench-p", &pargs);
+	for (i = 0; i < np + nc; i++)
+		rtl_thread_destroy(threads[i]);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return BENCH_ITEMS / ((end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+int main()
+{
+	static const int counts[][2] = {
+		{ 1, 1 }, { 1, 4 }, { 4, 1 }, { 2, 2 }, { 4, 4 }, { 8, 8 },
+	};
+	rtl_thread_t *p1, *p2, *c1, *c2;
+	long sum1 = 0, sum2 = 0;
+	size_t i;
+
+	q = rtl_mpmc_create(1024);
+	if (!q)
+		return -1;
+
+	c1 = rtl_thread_create(consumer, "c1", &sum1);
+	c2 = rtl_thread_create(consumer, "c2", &sum2);
+	p1 = rtl_thread_create(producer, "p1", NULL);
+	p2 = rtl_thread_create(producer, "p2", NULL);
+
+	/* destroy joins the thread */
+	rtl_thread_destroy(p1);
+	rtl_thread_destroy(p2);
+	rtl_thread_destroy(c1);
+	rtl_thread_destroy(c2);
+
+	printf("sum = %ld, expected %ld\n", sum1 + sum2,
+			(long)NUM_ITEMS * (NUM_ITEMS + 1));
+
+	rtl_mpmc_destroy(q);
+
+	lq.lock = rtl_mutex_lock_init();
+	lq.not_empty = rtl_mutex_cond_init();
+	lq.not_full = rtl_mutex_cond_init();
+	q = rtl_mpmc_create(QUEUE_SIZE);
+	if (!lq.lock || !lq.not_empty || !lq.not_full || !q)
+		return -1;
+
+	printf("\n%d items, queues of %d\n", BENCH_ITEMS, QUEUE_SIZE);
+	printf("producers consumers   mpmc Mitems/s   mutex+cond Mitems/s\n");
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		printf("%9d %9d %17.2f %21.2f\n", counts[i][0], counts[i][1],
+				bench(0, counts[i][0], counts[i][1]) / 1e6,
+				bench(1, counts[i][0], counts[i][1]) / 1e6);
+	}
+
+	rtl_mpmc_destroy(q);
+	rtl_mutex_cond_deinit(lq.not_full);
+	rtl_mutex_cond_deinit(lq.not_empty);
+	rtl_mutex_lock_deinit(lq.lock);
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+
+#include <rtl_pool.h>
+
+#define NUM_TASKS	1000
+
+static rtl_pool_t *pool;
+static long sums[NUM_TASKS];
+
+void sum_task(void *args)
+{
+	long n = (long)args;
+	long i;
+
+	for (i = 1; i <= n; i++)
+		sums[n] += i;
+}
+
+void split_task(void *args)
+{
+	long i;
+
+	/* tasks submitted from a worker go to its own deque */
+	for (i = 0; i < NUM_TASKS; i++)
+		rtl_pool_submit(pool, sum_task, (void *)i);
+}
+
+int main()
+{
+	long i;
+
+	pool = rtl_pool_create(0);
+	if (!pool)
+		return -1;
+
+	printf("workers = %d\n", rtl_pool_size(pool));
+
+	rtl_pool_submit(pool, split_task, NULL);
+	rtl_pool_wait(pool);
+
+	for (i = 0; i < NUM_TASKS; i++) {
+		if (sums[i] != i * (i + 1) / 2) {
+			printf("task %ld failed!\n", i);
+			break;
+		}
+	}
+	if (i == NUM_TASKS)
+		printf("%d tasks done\n", NUM_TASKS);
+
+	rtl_pool_destroy(pool);
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include <rtl_lock.h>
+#include <rtl_thread.h>
+
+#define MAX_THREADS		32
+#define RUN_MSEC		100
+#define DATA_LEN		16
+
+static rtl_rwlock_t *rwlock;
+static rtl_brlock_t *brlock;
+static volatile int start, stop;
+static long data[DATA_LEN];
+
+struct bench_args {
+	int use_br;
+	int ratio;				/* reads per write, 0 for reads only */
+	uint32_t seed;
+	long ops;
+	long sink;
+};
+
+static uint32_t next_rand(struct bench_args *args)
+{
+	/* xorshift32 */
+	args->seed ^= args->seed << 13;
+	args->seed ^= args->seed >> 17;
+	args->seed ^= args->seed << 5;
+	return args->seed;
+}
+
+static void do_read(struct bench_args *args)
+{
+	int i;
+
+	if (args->use_br)
+		rtl_brlock_rdlock(brlock);
+	else
+		rtl_rwlock_rdlock(rwlock);
+	for (i = 0; i < DATA_LEN; i++)
+		args->sink += data[i];
+	if (args->use_br)
+		rtl_brlock_rdunlock(brlock);
+	else
+		rtl_rwlock_unlock(rwlock);
+}
+
+static void do_write(struct bench_args *args)
+{
+	int i;
+
+	if (args->use_br)
+		rtl_brlock_wrlock(brlock);
+	else
+		rtl_rwlock_wrlock(rwlock);
+	for (i = 0; i < DATA_LEN; i++)
+		data[i]++;
+	if (args->use_br)
+		rtl_brlock_wrunlock(brlock);
+	else
+		rtl_rwlock_unlock(rwlock);
+}
+
+void *worker(rtl_thread_t *t)
+{
+	struct bench_args *args = (struct bench_args *)t->args;
+
+	while (!start)
+		sched_yield();
+	while (!stop) {
+		if (args->ratio && next_rand(args) % (args->ratio + 1) == 0)
+			do_write(args);
+		else
+			do_read(args);
+		args->ops++;
+	}
+
+	return NULL;
+}
+
+/* operations per second of nthreads mixing reads and writes on one lock */
+static double bench(int use_br, int ratio, int nthreads)
+{
+	rtl_thread_t *threads[MAX_THREADS];
+	struct bench_args args[MAX_THREADS];
+	struct timespec begin, end;
+	long total = 0;
+	int i;
+
+	start = stop = 0;
+	for (i = 0; i < nthreads; i++) {
+		args[i].use_br = use_br;
+		args[i].ratio = ratio;
+		args[i].seed = 2463534242u + i * 2654435761u;
+		args[i].ops = 0;
+		args[i].sink = 0;
+		threads[i] = rtl_thread_create(worker, "rwlock-bench", &args[i]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	start = 1;
+	usleep(RUN_MSEC * 1000);
+	stop = 1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	for (i = 0; i < nthreads; i++) {
+		rtl_thread_destroy(threads[i]);
+		total += args[i].ops;
+	}
+
+	return total / ((end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9);
+}
+
+int main()
+{
+	static const int ratios[] = { 0, 1000, 100, 10 };
+	int i, n;
+
+	rwlock = rtl_rwlock_init();
+	brlock = rtl_brlock_init();
+	if (!rwlock || !brlock)
+		return -1;
+
+	printf("%d ms per run, %ld cpus\n", RUN_MSEC, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("reads/write threads   rwlock Mops/s   brlock Mops/s\n");
+	for (i = 0; i < sizeof(ratios) / sizeof(ratios[0]); i++) {
+		for (n = 1; n <= MAX_THREADS; n <<= 1) {
+			if (ratios[i])
+				printf("%11d", ratios[i]);
+			else
+				printf("%11s", "reads only");
+			printf(" %7d %15.2f %15.2f\n", n, bench(0, ratios[i], n) / 1e6,
+					bench(1, ratios[i], n) / 1e6);
+		}
+	}
+
+	rtl_brlock_deinit(brlock);
+	rtl_rwlock_deinit(rwlock);
+
+	return 0;
+}
@@ -4,6 +4,67 @@
 #include <rtl_shm.h>
 #include <unistd.h>
 
+#define NUM_BLOCKS	8
+#define BLOCK_SIZE	1000
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s: %s failed\n", name, #cond); \
+			return -1; \
+		} \
+	} while (0)
+
+/*
+ * allocate NUM_BLOCKS equal blocks, free every other one but the last,
+ * so the holes cannot merge with the free tail, then free the rest.
+ */
+int check_stats(int mode, const char *name)
+{
+	rtl_shm_ctl_block_t *heap;
+	struct rtl_shm_stats fresh, full, holes, st;
+	void *p[NUM_BLOCKS];
+	size_t block;
+	int i;
+
+	heap = rtl_shm_init_mode(1024 * 64, mode);
+	if (!heap)
+		return -1;
+
+	rtl_shm_stats(heap, &fresh);
+	CHECK(fresh.used_blocks == 0 && fresh.free_blocks == 1);
+	CHECK(fresh.largest_free == fresh.free_bytes);
+
+	for (i = 0; i < NUM_BLOCKS; i++)
+		p[i] = rtl_shm_malloc(heap, BLOCK_SIZE);
+	rtl_shm_stats(heap, &full);
+	block = full.used_bytes / NUM_BLOCKS;
+	CHECK(full.used_blocks == NUM_BLOCKS && block >= BLOCK_SIZE);
+	CHECK(full.used_bytes == NUM_BLOCKS * block);
+	CHECK(full.free_blocks == 1 && full.largest_free == full.free_bytes);
+
+	for (i = 0; i < NUM_BLOCKS - 1; i += 2)
+		rtl_shm_free(heap, p[i]);
+	rtl_shm_stats(heap, &holes);
+	CHECK(holes.used_blocks == NUM_BLOCKS / 2);
+	CHECK(holes.used_bytes == NUM_BLOCKS / 2 * block);
+	CHECK(holes.free_blocks == NUM_BLOCKS / 2 + 1);
+	CHECK(holes.free_bytes == full.free_bytes + NUM_BLOCKS / 2 * block);
+	CHECK(holes.largest_free == full.largest_free);
+	CHECK(holes.fragmentation > 0);
+
+	for (i = 1; i < NUM_BLOCKS; i += 2)
+		rtl_shm_free(heap, p[i]);
+	rtl_shm_stats(heap, &st);
+	CHECK(st.used_bytes == 0 && st.free_blocks == 1);
+	CHECK(st.free_bytes == fresh.free_bytes && st.largest_free == fresh.largest_free);
+
+	rtl_shm_sem_del(heap);
+	rtl_shm_mem_del(heap);
+	printf("%s: stats ok\n", name);
+	return 0;
+}
+
 rtl_shm_ctl_block_t *scb;
 
 void signal_handler(int signo)
@@ -17,6 +78,10 @@ int main()
 {
 	char *tmp;
 
+	if (check_stats(RTL_SHM_FIRST_FIT, "first fit") < 0 ||
+		check_stats(RTL_SHM_TLSF, "tlsf") < 0)
+		return -1;
+
 	signal(SIGINT, signal_handler);
 
 	scb = rtl_shm_init(1024 * 10);
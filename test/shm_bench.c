@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <rtl_shm.h>
+
+#define NUM_SLOTS	4096
+#define NUM_OPS		1000000
+
+static void *slots[NUM_SLOTS];
+
+static size_t rand_size(void)
+{
+	/* mostly small objects, a few large ones to fragment the heap */
+	if (rand() % 16 == 0)
+		return 4096 + rand() % 65536;
+	return 16 + rand() % 512;
+}
+
+/* nops random malloc/free through cache if not NULL, then free the rest */
+static int run_ops(rtl_shm_ctl_block_t *scb, rtl_shm_cache_t *cache, int nops)
+{
+	int i, n, failed = 0;
+
+	for (n = 0; n < nops; n++) {
+		i = rand() % NUM_SLOTS;
+		if (slots[i]) {
+			if (cache)
+				rtl_shm_cache_free(cache, slots[i]);
+			else
+				rtl_shm_free(scb, slots[i]);
+			slots[i] = NULL;
+		} else {
+			if (cache)
+				slots[i] = rtl_shm_cache_malloc(cache, rand_size());
+			else
+				slots[i] = rtl_shm_malloc(scb, rand_size());
+			if (!slots[i])
+				failed++;
+		}
+	}
+	for (i = 0; i < NUM_SLOTS; i++) {
+		if (cache)
+			rtl_shm_cache_free(cache, slots[i]);
+		else
+			rtl_shm_free(scb, slots[i]);
+		slots[i] = NULL;
+	}
+	return failed;
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * NUM_OPS split over nworkers forked processes sharing one heap, each
+ * worker creates its cache after the fork. nworkers 0 runs in place.
+ */
+static double bench(size_t seg_size, int mode, int cached, int nworkers, int *failed)
+{
+	rtl_shm_ctl_block_t *scb;
+	rtl_shm_cache_t *cache = NULL;
+	struct timespec start;
+	int *shared_failed;
+	double t;
+	int i;
+
+	scb = rtl_shm_init_mode(seg_size, mode);
+	if (!scb)
+		return -1;
+	shared_failed = rtl_shm_calloc(scb, 1, sizeof(int));
+	if (!shared_failed)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (nworkers == 0) {
+		if (cached)
+			cache = rtl_shm_cache_create(scb, 0, 0);
+		srand(1);
+		*shared_failed = run_ops(scb, cache, NUM_OPS);
+		rtl_shm_cache_destroy(cache);
+	}
+	for (i = 0; i < nworkers; i++) {
+		if (fork() == 0) {
+			if (cached)
+				cache = rtl_shm_cache_create(scb, 0, 0);
+			srand(1 + i);
+			__atomic_add_fetch(shared_failed,
+					run_ops(scb, cache, NUM_OPS / nworkers), __ATOMIC_RELAXED);
+			rtl_shm_cache_destroy(cache);
+			_exit(0);
+		}
+	}
+	while (wait(NULL) > 0)
+		;
+	t = elapsed(&start);
+
+	*failed = *shared_failed;
+	rtl_shm_sem_del(scb);
+	rtl_shm_mem_del(scb);
+
+	return t;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t seg_size = 1024UL * 1024 * 1024;
+	int max_workers = 8;
+	int failed, cfailed, n;
+	double t;
+
+	if (argc > 1)
+		seg_size = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		max_workers = atoi(argv[2]);
+
+	printf("segment %zu bytes, %d malloc/free\n", seg_size, NUM_OPS);
+
+	t = bench(seg_size, RTL_SHM_FIRST_FIT, 0, 0, &failed);
+	if (t < 0) {
+		printf("rtl_shm_init failed!\n");
+		return -1;
+	}
+	printf("first fit: %.3fs, %d failed\n", t, failed);
+
+	t = bench(seg_size, RTL_SHM_TLSF, 0, 0, &failed);
+	printf("tlsf:      %.3fs, %d failed\n", t, failed);
+
+	t = bench(seg_size, RTL_SHM_TLSF, 1, 0, &failed);
+	printf("cached:    %.3fs, %d failed\n", t, failed);
+
+	/* the same ops split over forked workers contending for the heap */
+	printf("\nworkers    tlsf   cached  failed\n");
+	for (n = 1; n <= max_workers; n <<= 1) {
+		t = bench(seg_size, RTL_SHM_TLSF, 0, n, &failed);
+		printf("%7d %6.3fs", n, t);
+		t = bench(seg_size, RTL_SHM_TLSF, 1, n, &cfailed);
+		printf(" %7.3fs %7d\n", t, failed + cfailed);
+	}
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include <rtl_lock.h>
+#include <rtl_thread.h>
+
+#define MAX_THREADS		64
+#define RUN_MSEC		200
+
+static rtl_spin_lock_t *lock;
+static volatile int start, stop;
+static long shared;
+static long counts[MAX_THREADS];
+
+void *worker(rtl_thread_t *t)
+{
+	long *count = (long *)t->args;
+
+	while (!start)
+		sched_yield();
+	while (!stop) {
+		rtl_spin_lock(lock);
+		/* a short critical section touching shared data */
+		shared++;
+		rtl_spin_unlock(lock);
+		(*count)++;
+	}
+
+	return NULL;
+}
+
+/*
+ * run nthreads against one lock for RUN_MSEC, return acquisitions per
+ * second and the spread of the per-thread counts: the slowest and the
+ * fastest thread relative to the mean, and the coefficient of variation.
+ */
+static double bench(int type, int nthreads, double *lo, double *hi, double *cv)
+{
+	rtl_thread_t *threads[MAX_THREADS];
+	struct timespec begin, end;
+	double mean, var, secs;
+	long total = 0, min, max;
+	int i;
+
+	lock = rtl_spin_lock_init_type(type);
+	if (!lock)
+		return -1;
+	start = stop = 0;
+	for (i = 0; i < nthreads; i++) {
+		counts[i] = 0;
+		threads[i] = rtl_thread_create(worker, "spin-bench", &counts[i]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	start = 1;
+	usleep(RUN_MSEC * 1000);
+	stop = 1;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	for (i = 0; i < nthreads; i++)
+		rtl_thread_destroy(threads[i]);
+	rtl_spin_lock_deinit(lock);
+
+	min = max = counts[0];
+	for (i = 0; i < nthreads; i++) {
+		total += counts[i];
+		if (counts[i] < min)
+			min = counts[i];
+		if (counts[i] > max)
+			max = counts[i];
+	}
+	mean = (double)total / nthreads;
+	for (var = 0, i = 0; i < nthreads; i++)
+		var += (counts[i] - mean) * (counts[i] - mean);
+	var /= nthreads;
+	*lo = mean ? min / mean : 0;
+	*hi = mean ? max / mean : 0;
+	*cv = mean ? sqrt(var) / mean : 0;
+
+	secs = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+	return total / secs;
+}
+
+int main()
+{
+	static const char *names[] = { "tas", "ticket", "mcs" };
+	static const int types[] = { RTL_SPIN_TAS, RTL_SPIN_TICKET, RTL_SPIN_MCS };
+	double ops, lo, hi, cv;
+	int i, n;
+
+	printf("%d ms per run, %ld cpus\n", RUN_MSEC, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("lock    threads     Mops/s   min/mean  max/mean     cv\n");
+	for (i = 0; i < 3; i++) {
+		for (n = 2; n <= MAX_THREADS; n <<= 1) {
+			ops = bench(types[i], n, &lo, &hi, &cv);
+			if (ops < 0) {
+				printf("rtl_spin_lock_init_type failed!\n");
+				return -1;
+			}
+			printf("%-7s %7d %10.2f %10.2f %9.2f %6.2f\n", names[i], n,
+					ops / 1e6, lo, hi, cv);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+
+#include <rtl_spsc.h>
+#include <rtl_thread.h>
+
+#define NUM_RECORDS	10000
+
+static rtl_spsc_t *q;
+
+void *producer(rtl_thread_t *t)
+{
+	char *rec;
+	int i, len;
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		while (!(rec = rtl_spsc_reserve(q, 64)))
+			sched_yield();
+		len = snprintf(rec, 64, "record %d", i) + 1;
+		rtl_spsc_commit(q, len);
+	}
+
+	return NULL;
+}
+
+int main()
+{
+	rtl_thread_t *t;
+	char expect[64];
+	char *rec;
+	size_t len;
+	int i;
+
+	/* elem_size 1 makes a record ring */
+	q = rtl_spsc_create(4096, 1);
+	if (!q)
+		return -1;
+
+	t = rtl_thread_create(producer, "producer", NULL);
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		while (!(rec = rtl_spsc_peek(q, &len)))
+			sched_yield();
+		snprintf(expect, sizeof(expect), "record %d", i);
+		if (strcmp(rec, expect)) {
+			printf("got \"%s\", expected \"%s\"\n", rec, expect);
+			break;
+		}
+		rtl_spsc_release(q);
+	}
+	if (i == NUM_RECORDS)
+		printf("%d records received\n", NUM_RECORDS);
+
+	rtl_thread_destroy(t);
+	rtl_spsc_destroy(q);
+
+	return 0;
+}